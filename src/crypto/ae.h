@@ -175,6 +175,19 @@ int ae_decrypt(ae_ctx     *ctx,
  *
  * ----------------------------------------------------------------------- */
 
+/* --------------------------------------------------------------------------
+ *
+ * Implementation Information
+ *
+ * ----------------------------------------------------------------------- */
+
+const char *ae_implementation(void); /* Name of implementation in use   */
+/* When several implementations are built in, the fastest one the processor
+ * can run is picked on first use. This names the one picked, for example
+ * "OCB (AES-NI)".
+ *
+ * ----------------------------------------------------------------------- */
+
 #ifdef __cplusplus
 } /* closing brace for extern "C" */
 #endif
@@ -55,6 +55,25 @@ static void * sse_alloc( int len )
   return ptr;
 }
 
+AlignedBuffer::~AlignedBuffer()
+{
+  free( buf );
+}
+
+void AlignedBuffer::reserve( size_t n )
+{
+  if ( n <= len ) {
+    return;
+  }
+
+  free( buf );
+  buf = NULL;
+  len = 0;
+
+  buf = (char *)sse_alloc( n );
+  len = n;
+}
+
 Base64Key::Base64Key( string printable_key )
 {
   if ( printable_key.length() != 22 ) {
@@ -168,62 +187,54 @@ Message::Message( Nonce s_nonce, string s_text )
     text( s_text )
 {}
 
-string Session::encrypt( Message plaintext )
+size_t Session::encrypt_in_place( Nonce nonce, char *buf, size_t text_len )
 {
-  const size_t pt_len = plaintext.text.size();
-  const int ciphertext_len = pt_len + 16;
-
-  char *ciphertext = (char *)sse_alloc( ciphertext_len );
-  char *pt = (char *)sse_alloc( pt_len );
-
-  memcpy( pt, plaintext.text.data(), plaintext.text.size() );
-
-  if ( (uint64_t( plaintext.nonce.data() ) & 0xf) != 0 ) {
+  if ( ((uint64_t( nonce.data() ) & 0xf) != 0)
+       || ((uint64_t( buf ) & 0xf) != 0) ) {
     throw CryptoException( "Bad alignment." );
   }
 
+  const int ciphertext_len = text_len + TAG_LEN;
+  char *text = buf + TEXT_OFFSET;
+
+  /* plaintext and ciphertext may be the same buffer */
   if ( ciphertext_len != ae_encrypt( ctx,                                     /* ctx */
-				     plaintext.nonce.data(),                  /* nonce */
-				     pt,                                      /* pt */
-				     pt_len,                                  /* pt_len */
+				     nonce.data(),                            /* nonce */
+				     text,                                    /* pt */
+				     text_len,                                /* pt_len */
 				     NULL,                                    /* ad */
 				     0,                                       /* ad_len */
-				     ciphertext,                              /* ct */
+				     text,                                    /* ct */
 				     NULL,                                    /* tag */
 				     AE_FINALIZE ) ) {                        /* final */
-    free( pt );
-    free( ciphertext );
     throw CryptoException( "ae_encrypt() returned error." );
   }
 
-  string text( (char *)ciphertext, ciphertext_len );
-  free( pt );
-  free( ciphertext );
+  memcpy( buf + DATAGRAM_OFFSET, nonce.data() + 4, NONCE_LEN );
 
-  return plaintext.nonce.cc_str() + text;
+  return NONCE_LEN + ciphertext_len;
 }
 
-Message Session::decrypt( string ciphertext )
+size_t Session::decrypt_in_place( char *buf, size_t datagram_len )
 {
-  if ( ciphertext.size() < 24 ) {
+  if ( datagram_len < NONCE_LEN + TAG_LEN ) {
     throw CryptoException( "Ciphertext must contain nonce and tag." );
   }
 
-  char *str = (char *)ciphertext.data();
+  if ( (uint64_t( buf ) & 0xf) != 0 ) {
+    throw CryptoException( "Bad alignment." );
+  }
 
-  int body_len = ciphertext.size() - 8;
-  int pt_len = body_len - 16;
+  int body_len = datagram_len - NONCE_LEN;
+  int pt_len = body_len - TAG_LEN;
 
   if ( pt_len < 0 ) { /* super-assertion that pt_len does not equal AE_INVALID */
     fprintf( stderr, "BUG.\n" );
     exit( 1 );
   }
 
-  Nonce __attribute__((__aligned__ (16))) nonce( str, 8 );
-  char *body = (char *)sse_alloc( body_len );
-  memcpy( body, str + 8, body_len );
-
-  char *plaintext = (char *)sse_alloc( pt_len );
+  Nonce __attribute__((__aligned__ (16))) nonce( buf + DATAGRAM_OFFSET, NONCE_LEN );
+  char *body = buf + TEXT_OFFSET;
 
   if ( pt_len != ae_decrypt( ctx,               /* ctx */
 			     nonce.data(),      /* nonce */
@@ -231,17 +242,38 @@ Message Session::decrypt( string ciphertext )
 			     body_len,          /* ct_len */
 			     NULL,              /* ad */
 			     0,                 /* ad_len */
-			     plaintext,         /* pt */
+			     body,              /* pt */
 			     NULL,              /* tag */
 			     AE_FINALIZE ) ) {  /* final */
-    free( plaintext );
-    free( body );
     throw CryptoException( "Packet failed integrity check." );
   }
 
-  Message ret( nonce, string( plaintext, pt_len ) );
-  free( plaintext );
-  free( body );
+  return pt_len;
+}
 
-  return ret;
+string Session::encrypt( Message plaintext )
+{
+  const size_t pt_len = plaintext.text.size();
+
+  AlignedBuffer buf;
+  buf.reserve( TEXT_OFFSET + pt_len + TAG_LEN );
+
+  memcpy( buf.data() + TEXT_OFFSET, plaintext.text.data(), pt_len );
+
+  size_t datagram_len = encrypt_in_place( plaintext.nonce, buf.data(), pt_len );
+
+  return string( buf.data() + DATAGRAM_OFFSET, datagram_len );
+}
+
+Message Session::decrypt( string ciphertext )
+{
+  AlignedBuffer buf;
+  buf.reserve( DATAGRAM_OFFSET + ciphertext.size() );
+
+  memcpy( buf.data() + DATAGRAM_OFFSET, ciphertext.data(), ciphertext.size() );
+
+  size_t pt_len = decrypt_in_place( buf.data(), ciphertext.size() );
+
+  return Message( buf.data() + DATAGRAM_OFFSET, NONCE_LEN,
+		  buf.data() + TEXT_OFFSET, pt_len );
 }
@@ -59,6 +59,26 @@ namespace Crypto {
     uint64_t val( void );
   };
   
+  /* A 16-byte-aligned block of memory for coding packets in place.
+     It keeps its storage between uses. Growing it loses the contents. */
+  class AlignedBuffer {
+  private:
+    char *buf;
+    size_t len;
+
+  public:
+    AlignedBuffer() : buf( NULL ), len( 0 ) {}
+    ~AlignedBuffer();
+
+    void reserve( size_t n );
+    char *data( void ) { return buf; }
+    size_t size( void ) const { return len; }
+
+    /* nonexistent methods to satisfy -Weffc++ */
+    AlignedBuffer( const AlignedBuffer & );
+    AlignedBuffer & operator=( const AlignedBuffer & );
+  };
+
   class Message {
   public:
     Nonce nonce;
@@ -75,11 +95,27 @@ namespace Crypto {
     ae_ctx *ctx;
     
   public:
+    /* Layout of a packet coded in place, from the start of a 16-byte-aligned
+       buffer. The datagram is the nonce, the text and the tag, with
+       the text on a 16-byte boundary as AES-OCB wants. */
+    static const size_t DATAGRAM_OFFSET = 8;
+    static const size_t NONCE_LEN = 8;
+    static const size_t TEXT_OFFSET = DATAGRAM_OFFSET + NONCE_LEN;
+    static const size_t TAG_LEN = 16;
+
     Session( Base64Key s_key );
     ~Session();
     
     string encrypt( Message plaintext );
     Message decrypt( string ciphertext );
+
+    /* Encrypts the text_len octets at buf + TEXT_OFFSET, writes the nonce
+       before them and the tag after, and returns the datagram length. */
+    size_t encrypt_in_place( Nonce nonce, char *buf, size_t text_len );
+
+    /* Decrypts the datagram at buf + DATAGRAM_OFFSET, leaving the text at
+       buf + TEXT_OFFSET, and returns the text length. */
+    size_t decrypt_in_place( char *buf, size_t datagram_len );
     
     Session( const Session & );
     Session & operator=( const Session & );
@@ -16,42 +16,24 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef PARSERTRANSITION_HPP
-#define PARSERTRANSITION_HPP
+/* AES-OCB with the AES-NI instructions. */
+
+#include "ocb-dispatch.h"
+
+#if OCB_RUNTIME_DISPATCH
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#pragma GCC target ("ssse3,aes")
+
+#define OCB_NAMESPACE ocb_aesni
+#define USE_OPENSSL_AES 0
+#define USE_REFERENCE_AES 0
+#define USE_AES_NI 1
+#define USE_SSSE3 1
 
-#include "parseraction.h"
-
-namespace Parser {
-  class State;
-
-  class Transition
-  {
-  public:
-    Action *action;
-    State *next_state;
-
-    Transition( const Transition &x )
-      : action( x.action ),
-	next_state( x.next_state ) {}
-    Transition & operator=( const Transition &t )
-    {
-      action = t.action;
-      next_state = t.next_state;
-
-      return *this;
-    }
-    virtual ~Transition() {}
-
-    Transition( Action *s_action=new Ignore, State *s_next_state=NULL )
-      : action( s_action ), next_state( s_next_state )
-    {}
-
-    Transition( State *s_next_state )
-      : action( new Ignore ), next_state( s_next_state )
-    {}
-  };
-}
+#include "ocb-impl.h"
 
 #endif
@@ -0,0 +1,69 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCB_DISPATCH_HPP
+#define OCB_DISPATCH_HPP
+
+/* The AES-OCB code in ocb-impl.h is compiled once for each kind of
+   processor it can be tuned for, each copy in its own namespace, and
+   ocb.cc passes the ae.h calls on to the copy this processor can run.
+
+   The tuned copies are compiled with "#pragma GCC target" instead of
+   compiler flags, so that the rest of the program still runs on any
+   processor of the architecture. Elsewhere there is only the reference
+   copy. */
+
+#include "ae.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) \
+  && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define OCB_RUNTIME_DISPATCH 1
+#else
+#define OCB_RUNTIME_DISPATCH 0
+#endif
+
+#define OCB_DECLARE_IMPLEMENTATION( ns )				\
+  namespace ns {							\
+    struct _ae_ctx;							\
+    typedef struct _ae_ctx ae_ctx;					\
+    ae_ctx* ae_allocate( void *misc );					\
+    void ae_free( ae_ctx *ctx );					\
+    int ae_clear( ae_ctx *ctx );					\
+    int ae_ctx_sizeof( void );						\
+    int ae_init( ae_ctx *ctx, const void *key, int key_len,		\
+		 int nonce_len, int tag_len );				\
+    int ae_encrypt( ae_ctx *ctx, const void *nonce,			\
+		    const void *pt, int pt_len, const void *ad, int ad_len, \
+		    void *ct, void *tag, int final );			\
+    int ae_decrypt( ae_ctx *ctx, const void *nonce,			\
+		    const void *ct, int ct_len, const void *ad, int ad_len, \
+		    void *pt, const void *tag, int final );		\
+    extern char infoString[];						\
+  }
+
+OCB_DECLARE_IMPLEMENTATION( ocb_reference )
+
+#if OCB_RUNTIME_DISPATCH
+OCB_DECLARE_IMPLEMENTATION( ocb_ssse3 )
+OCB_DECLARE_IMPLEMENTATION( ocb_aesni )
+#else
+namespace ocb_ssse3 = ocb_reference;
+namespace ocb_aesni = ocb_reference;
+#endif
+
+#endif
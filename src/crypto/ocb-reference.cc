@@ -0,0 +1,29 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* AES-OCB with Barreto's table-based AES, for any processor. */
+
+#include "ocb-dispatch.h"
+
+#define OCB_NAMESPACE ocb_reference
+#define USE_OPENSSL_AES 0
+#define USE_REFERENCE_AES 1
+#define USE_AES_NI 0
+#define USE_SSSE3 0
+
+#include "ocb-impl.h"
@@ -0,0 +1,40 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* AES-OCB with Barreto's table-based AES and SSSE3 byte shuffles,
+   for x86-64 processors without the AES instructions. */
+
+#include "ocb-dispatch.h"
+
+#if OCB_RUNTIME_DISPATCH
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#pragma GCC target ("ssse3")
+
+#define OCB_NAMESPACE ocb_ssse3
+#define USE_OPENSSL_AES 0
+#define USE_REFERENCE_AES 1
+#define USE_AES_NI 0
+#define USE_SSSE3 1
+
+#include "ocb-impl.h"
+
+#endif
@@ -176,29 +176,25 @@ int vt_parser( int fd, Parser::UTF8Parser *parser )
   }
 
   /* feed to parser */
-  for ( int i = 0; i < bytes_read; i++ ) {
-    std::list<Parser::Action *> actions = parser->input( buf[ i ] );
-    for ( std::list<Parser::Action *>::iterator j = actions.begin();
-	  j != actions.end();
-	  j++ ) {
-
-      Parser::Action *act = *j;
-      assert( act );
-
-      if ( act->char_present ) {
-	if ( iswprint( act->ch ) ) {
-	  printf( "%s(0x%02x=%lc) ", act->name().c_str(), (unsigned int)act->ch, act->ch );
-	} else {
-	  printf( "%s(0x%02x) ", act->name().c_str(), (unsigned int)act->ch );
-	}
-      } else {
-	printf( "[%s] ", act->name().c_str() );
-      }
+  Parser::HostActions actions;
+  parser->input( buf, bytes_read, actions );
+  for ( Parser::HostActions::iterator j = actions.begin();
+	j != actions.end();
+	j++ ) {
 
-      delete act;
+    Parser::HostAction *act = &*j;
 
-      fflush( stdout );
+    if ( act->char_present ) {
+      if ( iswprint( act->ch ) ) {
+	printf( "%s(0x%02x=%lc) ", act->name().c_str(), (unsigned int)act->ch, act->ch );
+      } else {
+	printf( "%s(0x%02x) ", act->name().c_str(), (unsigned int)act->ch );
+      }
+    } else {
+      printf( "[%s] ", act->name().c_str() );
     }
+
+    fflush( stdout );
   }
 
   return 0;
@@ -36,6 +36,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include "ae.h"
 #include "completeterminal.h"
 #include "swrite.h"
 #include "user.h"
@@ -119,7 +120,7 @@ int main( int argc, char *argv[] )
     _exit( 0 );
   }
 
-  fprintf( stderr, "[mosh-server detached, pid=%d.]\n", (int)getpid() );
+  fprintf( stderr, "[mosh-server detached, pid=%d, using %s.]\n", (int)getpid(), ae_implementation() );
 
   int master;
 
@@ -247,7 +248,12 @@ void serve( int host_fd, Terminal::Complete &terminal, ServerConnection &network
     try {
       uint64_t now = Network::timestamp();
 
-      int active_fds = poll( pollfds, 3, min( network.wait_time(), terminal.wait_time( now ) ) );
+      int timeout = min( network.wait_time(), terminal.wait_time( now ) );
+      if ( network.get_remote_state_num() != last_remote_num ) {
+	timeout = 0; /* recv() threw before new user input was applied */
+      }
+
+      int active_fds = poll( pollfds, 3, timeout );
       if ( active_fds < 0 ) {
 	perror( "poll" );
 	break;
@@ -256,61 +262,61 @@ void serve( int host_fd, Terminal::Complete &terminal, ServerConnection &network
       now = Network::timestamp();
 
       if ( pollfds[ 0 ].revents & POLLIN ) {
-	/* packet received from the network */
+	/* packets received from the network */
 	network.recv();
-	
-	/* is new user input available for the terminal? */
-	if ( network.get_remote_state_num() != last_remote_num ) {
-	  last_remote_num = network.get_remote_state_num();
-
-	  string terminal_to_host;
-	  
-	  Network::UserStream us;
-	  us.apply_string( network.get_remote_diff() );
-	  /* apply userstream to terminal */
-	  for ( size_t i = 0; i < us.size(); i++ ) {
-	    terminal_to_host += terminal.act( us.get_action( i ) );
-	    if ( typeid( *us.get_action( i ) ) == typeid( Parser::Resize ) ) {
-	      /* tell child process of resize */
-	      const Parser::Resize *res = static_cast<const Parser::Resize *>( us.get_action( i ) );
-	      struct winsize window_size;
-	      window_size.ws_col = res->width;
-	      window_size.ws_row = res->height;
-	      if ( ioctl( host_fd, TIOCSWINSZ, &window_size ) < 0 ) {
-		perror( "ioctl TIOCSWINSZ" );
-		return;
-	      }
+      }
+
+      /* is new user input available for the terminal? */
+      if ( network.get_remote_state_num() != last_remote_num ) {
+	last_remote_num = network.get_remote_state_num();
+
+	string terminal_to_host;
+
+	Network::UserStream us;
+	us.apply_string( network.get_remote_diff() );
+	/* apply userstream to terminal */
+	for ( size_t i = 0; i < us.size(); i++ ) {
+	  terminal_to_host += terminal.act( us.get_action( i ) );
+	  if ( typeid( *us.get_action( i ) ) == typeid( Parser::Resize ) ) {
+	    /* tell child process of resize */
+	    const Parser::Resize *res = static_cast<const Parser::Resize *>( us.get_action( i ) );
+	    struct winsize window_size;
+	    window_size.ws_col = res->width;
+	    window_size.ws_row = res->height;
+	    if ( ioctl( host_fd, TIOCSWINSZ, &window_size ) < 0 ) {
+	      perror( "ioctl TIOCSWINSZ" );
+	      return;
 	    }
 	  }
+	}
 
-	  if ( !us.empty() ) {
-	    /* register input frame number for future echo ack */
-	    terminal.register_input_frame( last_remote_num, now );
-	  }
+	if ( !us.empty() ) {
+	  /* register input frame number for future echo ack */
+	  terminal.register_input_frame( last_remote_num, now );
+	}
 
-	  /* update client with new state of terminal */
-	  if ( !network.shutdown_in_progress() ) {
-	    network.set_current_state( terminal );
-	  }
-	  
-	  /* write any writeback octets back to the host */
-	  if ( swrite( host_fd, terminal_to_host.c_str(), terminal_to_host.length() ) < 0 ) {
-	    break;
-	  }
+	/* update client with new state of terminal */
+	if ( !network.shutdown_in_progress() ) {
+	  network.set_current_state( terminal );
+	}
 
-	  /* update utmp entry if we have become "connected" */
-	  if ( (!connected_utmp)
-	       || ( saved_addr.s_addr != network.get_remote_ip().s_addr ) ) {
-	    utempter_remove_added_record();
+	/* write any writeback octets back to the host */
+	if ( swrite( host_fd, terminal_to_host.c_str(), terminal_to_host.length() ) < 0 ) {
+	  break;
+	}
 
-	    saved_addr = network.get_remote_ip();
+	/* update utmp entry if we have become "connected" */
+	if ( (!connected_utmp)
+	     || ( saved_addr.s_addr != network.get_remote_ip().s_addr ) ) {
+	  utempter_remove_added_record();
 
-	    char tmp[ 64 ];
-	    snprintf( tmp, 64, "%s via mosh [%d]", inet_ntoa( saved_addr ), getpid() );
-	    utempter_add_record( host_fd, tmp );
+	  saved_addr = network.get_remote_ip();
 
-	    connected_utmp = true;
-	  }
+	  char tmp[ 64 ];
+	  snprintf( tmp, 64, "%s via mosh [%d]", inet_ntoa( saved_addr ), getpid() );
+	  utempter_add_record( host_fd, tmp );
+
+	  connected_utmp = true;
 	}
       }
       
@@ -164,10 +164,9 @@ void STMClient::output_new_frame( void )
   overlays.apply( new_state );
 
   /* calculate minimal difference from where we are */
-  const string diff( Terminal::Display::new_frame( !repaint_requested,
-						   *local_framebuffer,
-						   new_state ) );
-  swrite( STDOUT_FILENO, diff.data(), diff.size() );
+  Terminal::Display::new_frame( !repaint_requested, *local_framebuffer, new_state,
+			       display_output );
+  swrite( STDOUT_FILENO, display_output.data(), display_output.size() );
   *local_framebuffer = new_state;  
 
   repaint_requested = false;
@@ -305,7 +304,7 @@ void STMClient::main( void )
       }
 
       if ( pollfds[ 0 ].revents & POLLIN ) {
-	/* packet received from the network */
+	/* packets received from the network */
 	if ( !process_network_input() ) { return; }
       }
     
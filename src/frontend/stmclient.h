@@ -40,6 +40,7 @@ private:
   struct winsize window_size;
 
   Terminal::Framebuffer *local_framebuffer;
+  std::string display_output; /* reused for each new frame */
   Overlay::OverlayManager overlays;
   Network::Transport< Network::UserStream, Terminal::Complete > *network;
 
@@ -59,6 +60,7 @@ public:
       winch_fd(), shutdown_signal_fd(),
       window_size(),
       local_framebuffer( NULL ),
+      display_output(),
       overlays(),
       network( NULL ),
       repaint_requested( false ),
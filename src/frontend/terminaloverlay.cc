@@ -22,10 +22,10 @@
 #include <algorithm>
 #include <wchar.h>
 #include <list>
-#include <typeinfo>
 #include <limits.h>
 
 #include "terminaloverlay.h"
+#include "mosh_wcwidth.h"
 
 using namespace boost::lambda;
 using namespace Overlay;
@@ -45,7 +45,7 @@ void ConditionalOverlayCell::apply( Framebuffer &fb, uint64_t confirmed_epoch, i
 
   if ( unknown ) {
     if ( flag && ( col != fb.ds.get_width() - 1 ) ) {
-      fb.get_mutable_cell( row, col )->renditions.underlined = true;
+      fb.get_mutable_cell( row, col )->renditions.set_attribute( Renditions::underlined, true );
     }
     return;
   }
@@ -57,7 +57,7 @@ void ConditionalOverlayCell::apply( Framebuffer &fb, uint64_t confirmed_epoch, i
 
     *(fb.get_mutable_cell( row, col )) = replacement;
     if ( flag ) {
-      fb.get_mutable_cell( row, col )->renditions.underlined = true;
+      fb.get_mutable_cell( row, col )->renditions.set_attribute( Renditions::underlined, true );
     }
   }
 }
@@ -87,11 +87,11 @@ Validity ConditionalOverlayCell::get_validity( const Framebuffer &fb, int row,
       return CorrectNoCredit;
     }
 
-    if ( (current.contents == replacement.contents)
+    if ( current.contents_match( replacement )
 	 || (current.is_blank() && replacement.is_blank()) ) {
       BOOST_AUTO( it, find_if( original_contents.begin(), original_contents.end(),
 			       (replacement.is_blank() && bind( &Cell::is_blank, _1 ))
-			       || replacement.contents == (&_1)->*&Cell::contents ) );
+			       || bind( &Cell::contents_match, &replacement, _1 ) ) );
       if ( it == original_contents.end() ) {
 	return Correct;
       } else {
@@ -176,9 +176,9 @@ void NotificationEngine::apply( Framebuffer &fb ) const
 
   /* draw bar across top of screen */
   Cell notification_bar( 0 );
-  notification_bar.renditions.foreground_color = 37;
-  notification_bar.renditions.background_color = 44;
-  notification_bar.contents.push_back( 0x20 );
+  notification_bar.renditions.set_foreground_color( 37 );
+  notification_bar.renditions.set_background_color( 44 );
+  notification_bar.append( 0x20 );
 
   for ( int i = 0; i < fb.ds.get_width(); i++ ) {
     *(fb.get_mutable_cell( 0, i )) = notification_bar;
@@ -211,7 +211,7 @@ void NotificationEngine::apply( Framebuffer &fb ) const
     }
 
     wchar_t ch = *i;
-    int chwidth = ch == L'\0' ? -1 : wcwidth( ch );
+    int chwidth = ch == L'\0' ? -1 : mosh_wcwidth( ch );
     Cell *this_cell = 0;
 
     switch ( chwidth ) {
@@ -219,12 +219,12 @@ void NotificationEngine::apply( Framebuffer &fb ) const
     case 2: /* wide character */
       this_cell = fb.get_mutable_cell( 0, overlay_col );
       fb.reset_cell( this_cell );
-      this_cell->renditions.bold = true;
-      this_cell->renditions.foreground_color = 37;
-      this_cell->renditions.background_color = 44;
+      this_cell->renditions.set_attribute( Renditions::bold, true );
+      this_cell->renditions.set_foreground_color( 37 );
+      this_cell->renditions.set_background_color( 44 );
       
-      this_cell->contents.push_back( ch );
-      this_cell->width = chwidth;
+      this_cell->append( ch );
+      this_cell->wide = (chwidth == 2);
       combining_cell = this_cell;
 
       overlay_col += chwidth;
@@ -234,14 +234,14 @@ void NotificationEngine::apply( Framebuffer &fb ) const
 	break;
       }
 
-      if ( combining_cell->contents.size() == 0 ) {
-	assert( combining_cell->width == 1 );
+      if ( combining_cell->empty() ) {
+	assert( !combining_cell->wide );
 	combining_cell->fallback = true;
 	overlay_col++;
       }
 
-      if ( combining_cell->contents.size() < 16 ) {
-	combining_cell->contents.push_back( ch );
+      if ( combining_cell->char_count() < 16 ) {
+	combining_cell->append( ch );
       }
       break;
     case -1: /* unprintable character */
@@ -543,17 +543,18 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
   }
   last_byte = the_byte;
 
-  list<Parser::Action *> actions( parser.input( the_byte ) );
+  Parser::HostActions actions;
+  parser.input( the_byte, actions );
 
   for ( BOOST_AUTO( it, actions.begin() ); it != actions.end(); it++ ) {
-    Parser::Action *act = *it;
+    const Parser::HostAction *act = &*it;
 
     /*
     fprintf( stderr, "Action: %s (%lc)\n",
 	     act->name().c_str(), act->char_present ? act->ch : L'_' );
     */
 
-    if ( typeid( *act ) == typeid( Parser::Print ) ) {
+    if ( act->type == Parser::PRINT ) {
       /* make new prediction */
 
       init_cursor( fb );
@@ -600,7 +601,7 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	    }
 	  }
 	}
-      } else if ( (ch < 0x20) || (wcwidth( ch ) != 1) ) {
+      } else if ( (ch < 0x20) || (mosh_wcwidth( ch ) != 1) ) {
 	/* unknown print */
 	become_tentative();
 	//	fprintf( stderr, "Unknown print 0x%x\n", ch );
@@ -651,8 +652,8 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	cell.tentative_until_epoch = prediction_epoch;
 	cell.expire( local_frame_sent + 1, now );
 	cell.replacement.renditions = fb.ds.get_renditions();
-	cell.replacement.contents.clear();
-	cell.replacement.contents.push_back( ch );
+	cell.replacement.clear();
+	cell.replacement.append( ch );
 	cell.original_contents.push_back( *fb.get_cell( cursor().row, cursor().col ) );
 
 	/*
@@ -672,7 +673,7 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	  newline_carriage_return( fb );
 	}
       }
-    } else if ( typeid( *act ) == typeid( Parser::Execute ) ) {
+    } else if ( act->type == Parser::EXECUTE ) {
       if ( act->char_present && (act->ch == 0x0d) /* CR */ ) {
 	become_tentative();
 	newline_carriage_return( fb );
@@ -680,10 +681,10 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	//	fprintf( stderr, "Execute 0x%x\n", act->ch );
 	become_tentative();	
       }
-    } else if ( typeid( *act ) == typeid( Parser::Esc_Dispatch ) ) {
+    } else if ( act->type == Parser::ESC_DISPATCH ) {
       //      fprintf( stderr, "Escape sequence\n" );
       become_tentative();
-    } else if ( typeid( *act ) == typeid( Parser::CSI_Dispatch ) ) {
+    } else if ( act->type == Parser::CSI_DISPATCH ) {
       if ( act->char_present && (act->ch == L'C') ) { /* right arrow */
 	init_cursor( fb );
 	if ( cursor().col < fb.ds.get_width() - 1 ) {
@@ -701,11 +702,9 @@ void PredictionEngine::new_user_byte( char the_byte, const Framebuffer &fb )
 	//	fprintf( stderr, "CSI sequence %lc\n", act->ch );
 	become_tentative();
       }
-    } else if ( typeid( *act ) == typeid( Parser::Clear ) ) {
+    } else if ( act->type == Parser::CLEAR ) {
 
     }
-
-    delete act;
   }
 }
 
@@ -730,7 +729,7 @@ void PredictionEngine::newline_carriage_return( const Framebuffer &fb )
       j->active = true;
       j->tentative_until_epoch = prediction_epoch;
       j->expire( local_frame_sent + 1, now );
-      j->replacement.contents.clear();
+      j->replacement.clear();
     }
   } else {
     cursor().row++;
@@ -16,13 +16,18 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "config.h"
+
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <assert.h>
 #include <endian.h>
 #include <errno.h>
+#include <string.h>
 
 #include "dos_assert.h"
 #include "network.h"
@@ -35,41 +40,43 @@ using namespace Crypto;
 const uint64_t DIRECTION_MASK = uint64_t(1) << 63;
 const uint64_t SEQUENCE_MASK = uint64_t(-1) ^ DIRECTION_MASK;
 
-/* Read in packet from coded string */
-Packet::Packet( string coded_packet, Session *session )
+/* Read in packet by decoding, in place, the datagram in a packet buffer */
+Packet::Packet( char *buf, size_t datagram_len, Session *session )
   : seq( -1 ),
     direction( TO_SERVER ),
     timestamp( -1 ),
     timestamp_reply( -1 ),
     payload()
 {
-  Message message = session->decrypt( coded_packet );
+  size_t text_len = session->decrypt_in_place( buf, datagram_len );
+
+  Nonce nonce( buf + Session::DATAGRAM_OFFSET, Session::NONCE_LEN );
 
-  direction = (message.nonce.val() & DIRECTION_MASK) ? TO_CLIENT : TO_SERVER;
-  seq = message.nonce.val() & SEQUENCE_MASK;
+  direction = (nonce.val() & DIRECTION_MASK) ? TO_CLIENT : TO_SERVER;
+  seq = nonce.val() & SEQUENCE_MASK;
 
-  dos_assert( message.text.size() >= 2 * sizeof( uint16_t ) );
+  dos_assert( text_len >= HEADER_LEN );
 
-  uint16_t *data = (uint16_t *)message.text.data();
+  uint16_t *data = (uint16_t *)( buf + Session::TEXT_OFFSET );
   timestamp = be16toh( data[ 0 ] );
   timestamp_reply = be16toh( data[ 1 ] );
 
-  payload = string( message.text.begin() + 2 * sizeof( uint16_t ), message.text.end() );
+  payload = string( buf + PAYLOAD_OFFSET, text_len - HEADER_LEN );
 }
 
-/* Output coded string from packet */
-string Packet::tostring( Session *session )
+/* Code packet in place in a packet buffer that already holds the payload */
+size_t Packet::encode( char *buf, size_t payload_len, Session *session )
 {
   uint64_t direction_seq = (uint64_t( direction == TO_CLIENT ) << 63) | (seq & SEQUENCE_MASK);
 
-  uint16_t ts_net[ 2 ] = { htobe16( timestamp ), htobe16( timestamp_reply ) };
+  uint16_t *data = (uint16_t *)( buf + Session::TEXT_OFFSET );
+  data[ 0 ] = htobe16( timestamp );
+  data[ 1 ] = htobe16( timestamp_reply );
 
-  string timestamps = string( (char *)ts_net, 2 * sizeof( uint16_t ) );
-
-  return session->encrypt( Message( Nonce( direction_seq ), timestamps + payload ) );
+  return session->encrypt_in_place( Nonce( direction_seq ), buf, HEADER_LEN + payload_len );
 }
 
-Packet Connection::new_packet( string &s_payload )
+Packet Connection::new_packet( void )
 {
   uint16_t outgoing_timestamp_reply = -1;
 
@@ -82,7 +89,7 @@ Packet Connection::new_packet( string &s_payload )
     saved_timestamp_received_at = 0;
   }
 
-  Packet p( next_seq++, direction, timestamp16(), outgoing_timestamp_reply, s_payload );
+  Packet p( next_seq++, direction, timestamp16(), outgoing_timestamp_reply, string() );
 
   return p;
 }
@@ -101,6 +108,8 @@ void Connection::setup( void )
   if ( setsockopt( sock, IPPROTO_IP, IP_MTU_DISCOVER, &flag, optlen ) < 0 ) {
     throw NetworkException( "setsockopt", errno );
   }
+
+  receive_buffer.reserve( RECEIVE_BATCH * RECEIVE_SLOT );
 }
 
 Connection::Connection( const char *desired_ip ) /* server */
@@ -118,7 +127,15 @@ Connection::Connection( const char *desired_ip ) /* server */
     expected_receiver_seq( 0 ),
     RTT_hit( false ),
     SRTT( 1000 ),
-    RTTVAR( 500 )
+    RTTVAR( 500 ),
+    send_buffer(),
+    send_datagrams(),
+    segmentation_offload( true ),
+    receive_buffer(),
+    receive_addr(),
+    receive_length(),
+    receive_count( 0 ),
+    receive_next( 0 )
 {
   setup();
 
@@ -163,7 +180,15 @@ Connection::Connection( const char *key_str, const char *ip, int port ) /* clien
     expected_receiver_seq( 0 ),
     RTT_hit( false ),
     SRTT( 1000 ),
-    RTTVAR( 500 )
+    RTTVAR( 500 ),
+    send_buffer(),
+    send_datagrams(),
+    segmentation_offload( true ),
+    receive_buffer(),
+    receive_addr(),
+    receive_length(),
+    receive_count( 0 ),
+    receive_next( 0 )
 {
   setup();
 
@@ -181,45 +206,234 @@ Connection::Connection( const char *key_str, const char *ip, int port ) /* clien
 }
 
 void Connection::send( string s )
+{
+  send_batch( vector<string>( 1, s ) );
+}
+
+void Connection::send_batch( const vector<string> &payloads )
 {
   assert( attached );
 
-  Packet px = new_packet( s );
+  /* each packet gets its own aligned slot, so it can be coded in
+     place and sent from where it is */
+  size_t total_len = 0;
+  for ( vector<string>::const_iterator i = payloads.begin();
+	i != payloads.end();
+	i++ ) {
+    total_len += Packet::buffer_len( i->size() );
+  }
 
-  string p = px.tostring( &session );
+  send_buffer.reserve( total_len );
+  send_datagrams.clear();
 
-  ssize_t bytes_sent = sendto( sock, p.data(), p.size(), 0,
-			       (sockaddr *)&remote_addr, sizeof( remote_addr ) );
+  char *slot = send_buffer.data();
+  for ( vector<string>::const_iterator i = payloads.begin();
+	i != payloads.end();
+	i++ ) {
+    memcpy( slot + Packet::PAYLOAD_OFFSET, i->data(), i->size() );
 
-  if ( bytes_sent == static_cast<ssize_t>( p.size() ) ) {
-    return;
-  } else {
-    throw NetworkException( "sendto", errno );
+    Packet px = new_packet();
+
+    struct iovec datagram;
+    datagram.iov_base = slot + Session::DATAGRAM_OFFSET;
+    datagram.iov_len = px.encode( slot, i->size(), &session );
+    send_datagrams.push_back( datagram );
+
+    slot += Packet::buffer_len( i->size() );
+  }
+
+  for ( size_t first = 0; first < send_datagrams.size(); first += SEND_BATCH ) {
+    int count = min( static_cast<size_t>( SEND_BATCH ), send_datagrams.size() - first );
+
+    send_group( &send_datagrams[ first ], count );
   }
 }
 
-string Connection::recv( void )
+/* Send a group of datagrams. Where the kernel can split them itself
+   (UDP_SEGMENT), hand them over in one call; otherwise send them all
+   with one call to sendmmsg. */
+void Connection::send_group( const struct iovec *datagrams, int count )
 {
-  struct sockaddr_in packet_remote_addr;
+  assert( count <= SEND_BATCH );
+
+#ifdef UDP_SEGMENT
+  /* segmentation needs every datagram but the last to be the same length */
+  if ( segmentation_offload && (count > 1) ) {
+    size_t total_len = datagrams[ count - 1 ].iov_len;
+    bool uniform = datagrams[ count - 1 ].iov_len <= datagrams[ 0 ].iov_len;
+    for ( int i = 0; i < count - 1; i++ ) {
+      uniform = uniform && (datagrams[ i ].iov_len == datagrams[ 0 ].iov_len);
+      total_len += datagrams[ i ].iov_len;
+    }
 
-  char buf[ RECEIVE_MTU ];
+    if ( uniform && send_segmented( datagrams, count, total_len ) ) {
+      return;
+    }
+  }
+#endif
+
+#ifdef HAVE_SENDMMSG
+  struct mmsghdr messages[ SEND_BATCH ];
+
+  for ( int i = 0; i < count; i++ ) {
+    messages[ i ].msg_hdr.msg_name = &remote_addr;
+    messages[ i ].msg_hdr.msg_namelen = sizeof( remote_addr );
+    messages[ i ].msg_hdr.msg_iov = const_cast<struct iovec *>( &datagrams[ i ] );
+    messages[ i ].msg_hdr.msg_iovlen = 1;
+    messages[ i ].msg_hdr.msg_control = NULL;
+    messages[ i ].msg_hdr.msg_controllen = 0;
+    messages[ i ].msg_hdr.msg_flags = 0;
+    messages[ i ].msg_len = 0;
+  }
 
-  socklen_t addrlen = sizeof( packet_remote_addr );
+  /* sendmmsg stops early on an error, which the next call then reports */
+  int sent = 0;
+  while ( sent < count ) {
+    int n = sendmmsg( sock, messages + sent, count - sent, 0 );
+    if ( n < 0 ) {
+      throw NetworkException( "sendmmsg", errno );
+    }
+    sent += n;
+  }
+#else
+  for ( int i = 0; i < count; i++ ) {
+    ssize_t bytes_sent = sendto( sock, datagrams[ i ].iov_base, datagrams[ i ].iov_len, 0,
+				 (sockaddr *)&remote_addr, sizeof( remote_addr ) );
 
-  ssize_t received_len = recvfrom( sock, buf, RECEIVE_MTU, 0, (sockaddr *)&packet_remote_addr, &addrlen );
+    if ( bytes_sent != static_cast<ssize_t>( datagrams[ i ].iov_len ) ) {
+      throw NetworkException( "sendto", errno );
+    }
+  }
+#endif
+}
+
+/* Send datagrams in one call for the kernel to cut apart at the length
+   of the first. Returns false (and stops trying) if the kernel, route
+   or device can't do it, in which case nothing was sent. */
+#ifdef UDP_SEGMENT
+bool Connection::send_segmented( const struct iovec *datagrams, int count, size_t total_len )
+{
+  uint16_t segment_len = datagrams[ 0 ].iov_len;
+
+  union {
+    char buf[ CMSG_SPACE( sizeof( uint16_t ) ) ];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr message;
+  message.msg_name = &remote_addr;
+  message.msg_namelen = sizeof( remote_addr );
+  message.msg_iov = const_cast<struct iovec *>( datagrams );
+  message.msg_iovlen = count;
+  message.msg_control = control.buf;
+  message.msg_controllen = sizeof( control.buf );
+  message.msg_flags = 0;
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( &message );
+  cmsg->cmsg_level = IPPROTO_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+  memcpy( CMSG_DATA( cmsg ), &segment_len, sizeof( uint16_t ) );
+
+  ssize_t bytes_sent = sendmsg( sock, &message, 0 );
+
+  if ( bytes_sent == static_cast<ssize_t>( total_len ) ) {
+    return true;
+  }
 
-  if ( received_len < 0 ) {
-    throw NetworkException( "recvfrom", errno );
+  if ( (bytes_sent < 0)
+       && ( (errno == EINVAL) || (errno == EIO) || (errno == ENOPROTOOPT) || (errno == EOPNOTSUPP) ) ) {
+    /* e.g. old kernel, no checksum offload, or datagrams bigger than the route MTU */
+    segmentation_offload = false;
+    return false;
   }
 
+  throw NetworkException( "sendmsg", errno );
+}
+#endif
+
+/* Read every datagram waiting on the socket (up to one batch) into
+   the receive buffers, blocking only until the first one arrives. */
+void Connection::fill_receive_batch( void )
+{
+  assert( !recv_pending() );
+
+  receive_count = receive_next = 0;
+
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr messages[ RECEIVE_BATCH ];
+  struct iovec iovecs[ RECEIVE_BATCH ];
+
+  for ( int i = 0; i < RECEIVE_BATCH; i++ ) {
+    iovecs[ i ].iov_base = receive_slot( i ) + Session::DATAGRAM_OFFSET;
+    iovecs[ i ].iov_len = RECEIVE_MTU;
+
+    messages[ i ].msg_hdr.msg_name = &receive_addr[ i ];
+    messages[ i ].msg_hdr.msg_namelen = sizeof( receive_addr[ i ] );
+    messages[ i ].msg_hdr.msg_iov = &iovecs[ i ];
+    messages[ i ].msg_hdr.msg_iovlen = 1;
+    messages[ i ].msg_hdr.msg_control = NULL;
+    messages[ i ].msg_hdr.msg_controllen = 0;
+    messages[ i ].msg_hdr.msg_flags = 0;
+    messages[ i ].msg_len = 0;
+  }
+
+  int received = recvmmsg( sock, messages, RECEIVE_BATCH, MSG_WAITFORONE, NULL );
+
+  if ( received < 0 ) {
+    throw NetworkException( "recvmmsg", errno );
+  }
+
+  for ( int i = 0; i < received; i++ ) {
+    receive_length[ i ] = messages[ i ].msg_len;
+  }
+
+  receive_count = received;
+#else
+  /* no recvmmsg, so wait for one datagram and then read until the socket is empty */
+  while ( receive_count < RECEIVE_BATCH ) {
+    socklen_t addrlen = sizeof( receive_addr[ receive_count ] );
+
+    ssize_t received_len = recvfrom( sock, receive_slot( receive_count ) + Session::DATAGRAM_OFFSET, RECEIVE_MTU,
+				     receive_count ? MSG_DONTWAIT : 0,
+				     (sockaddr *)&receive_addr[ receive_count ], &addrlen );
+
+    if ( received_len < 0 ) {
+      if ( receive_count && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ) {
+	break;
+      }
+      throw NetworkException( "recvfrom", errno );
+    }
+
+    receive_length[ receive_count ] = received_len;
+    receive_count++;
+  }
+#endif
+}
+
+string Connection::recv( void )
+{
+  if ( !recv_pending() ) {
+    fill_receive_batch();
+  }
+
+  /* move past the datagram first, so a bad one is not returned again */
+  int i = receive_next++;
+
+  return process_datagram( receive_slot( i ), receive_length[ i ], receive_addr[ i ] );
+}
+
+/* Decode the datagram in a receive slot and take note of where it came from */
+string Connection::process_datagram( char *slot, int received_len, const struct sockaddr_in &packet_remote_addr )
+{
   if ( received_len > RECEIVE_MTU ) {
     char buffer[ 2048 ];
     snprintf( buffer, 2048, "Received oversize datagram (size %d) and limit is %d\n",
-	      static_cast<int>( received_len ), RECEIVE_MTU );
+	      received_len, RECEIVE_MTU );
     throw NetworkException( buffer, errno );
   }
 
-  Packet p( string( buf, received_len ), &session );
+  Packet p( slot, received_len, &session );
 
   dos_assert( p.direction == (server ? TO_SERVER : TO_CLIENT) ); /* prevent malicious playback to sender */
 
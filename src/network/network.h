@@ -21,7 +21,9 @@
 
 #include <stdint.h>
 #include <deque>
+#include <vector>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <string>
 #include <math.h>
@@ -31,7 +33,7 @@
 using namespace Crypto;
 
 namespace Network {
-  static const unsigned int MOSH_PROTOCOL_VERSION = 2; /* bumped for echo-ack */
+  static const unsigned int MOSH_PROTOCOL_VERSION = 3; /* bumped for screen diffs */
 
   uint64_t timestamp( void );
   uint16_t timestamp16( void );
@@ -62,14 +64,32 @@ namespace Network {
 	timestamp( s_timestamp ), timestamp_reply( s_timestamp_reply ), payload( s_payload )
     {}
     
-    Packet( string coded_packet, Session *session );
-    
-    string tostring( Session *session );
+    /* Packets are coded in place in a 16-byte-aligned packet buffer
+       laid out as Session describes. The text is the timestamps, then
+       the payload. */
+    static const size_t HEADER_LEN = 2 * sizeof( uint16_t );
+    static const size_t PAYLOAD_OFFSET = Session::TEXT_OFFSET + HEADER_LEN;
+
+    /* Room for a packet with the given payload, rounded up so the next one stays aligned */
+    static size_t buffer_len( size_t payload_len )
+    {
+      return (PAYLOAD_OFFSET + payload_len + Session::TAG_LEN + 15) & ~size_t( 15 );
+    }
+
+    Packet( char *buf, size_t datagram_len, Session *session );
+
+    /* The payload must already be at buf + PAYLOAD_OFFSET; the payload
+       member is not used. Returns the length of the datagram, which
+       starts at buf + Session::DATAGRAM_OFFSET. */
+    size_t encode( char *buf, size_t payload_len, Session *session );
   };
 
   class Connection {
   private:
     static const int RECEIVE_MTU = 2048;
+    static const int RECEIVE_SLOT = Session::TEXT_OFFSET + RECEIVE_MTU;
+    static const int RECEIVE_BATCH = 32;
+    static const int SEND_BATCH = 32;
     static const int SEND_MTU = 1400;
     static const uint64_t MIN_RTO = 50; /* ms */
     static const uint64_t MAX_RTO = 1000; /* ms */
@@ -97,14 +117,40 @@ namespace Network {
     double SRTT;
     double RTTVAR;
 
-    Packet new_packet( string &s_payload );
+    Packet new_packet( void );
+
+    /* packets being sent, each coded in its own slot */
+    AlignedBuffer send_buffer;
+    std::vector<struct iovec> send_datagrams;
+    bool segmentation_offload;
+
+    void send_group( const struct iovec *datagrams, int count );
+    bool send_segmented( const struct iovec *datagrams, int count, size_t total_len );
+
+    /* datagrams read from the socket but not yet handed to the caller */
+    AlignedBuffer receive_buffer;
+    struct sockaddr_in receive_addr[ RECEIVE_BATCH ];
+    int receive_length[ RECEIVE_BATCH ];
+    int receive_count, receive_next;
+
+    char *receive_slot( int i ) { return receive_buffer.data() + i * RECEIVE_SLOT; }
+    void fill_receive_batch( void );
+    string process_datagram( char *slot, int received_len, const struct sockaddr_in &packet_remote_addr );
 
   public:
     Connection( const char *desired_ip ); /* server */
     Connection( const char *key_str, const char *ip, int port ); /* client */
     
     void send( string s );
+
+    /* Sends each payload as its own datagram, with as few system calls as possible. */
+    void send_batch( const std::vector<string> &payloads );
+
+    /* Returns the next datagram. When none are left over from the last
+       read, blocks for one and then takes everything else waiting. */
     string recv( void );
+    bool recv_pending( void ) const { return receive_next < receive_count; }
+
     int fd( void ) const { return sock; }
     int get_MTU( void ) const { return MTU; }
 
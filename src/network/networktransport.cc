@@ -18,8 +18,10 @@
 
 #include <assert.h>
 #include <iostream>
+#include <boost/optional.hpp>
 
 #include "networktransport.h"
+#include "dos_assert.h"
 
 #include "transportsender.cc"
 
@@ -31,7 +33,7 @@ Transport<MyState, RemoteState>::Transport( MyState &initial_state, RemoteState
 					    const char *desired_ip )
   : connection( desired_ip ),
     sender( &connection, initial_state ),
-    received_states( 1, TimestampedState<RemoteState>( timestamp(), 0, initial_remote ) ),
+    received_states( 1, ReceivedState<RemoteState>( timestamp(), 0, initial_remote ) ),
     last_receiver_state( initial_remote ),
     fragments(),
     verbose( false )
@@ -44,7 +46,7 @@ Transport<MyState, RemoteState>::Transport( MyState &initial_state, RemoteState
 					    const char *key_str, const char *ip, int port )
   : connection( key_str, ip, port ),
     sender( &connection, initial_state ),
-    received_states( 1, TimestampedState<RemoteState>( timestamp(), 0, initial_remote ) ),
+    received_states( 1, ReceivedState<RemoteState>( timestamp(), 0, initial_remote ) ),
     last_receiver_state( initial_remote ),
     fragments(),
     verbose( false )
@@ -55,7 +57,39 @@ Transport<MyState, RemoteState>::Transport( MyState &initial_state, RemoteState
 template <class MyState, class RemoteState>
 void Transport<MyState, RemoteState>::recv( void )
 {
-  string s( connection.recv() );
+  /* take every packet that has arrived, so the caller applies and
+     draws the result once instead of once per packet */
+
+  /* A bad packet must not strand the good ones behind it in the batch,
+     where poll() can't see them, so keep going and report the first
+     error once the batch is empty. */
+  boost::optional<NetworkException> network_error;
+  boost::optional<Crypto::CryptoException> crypto_error;
+
+  do {
+    try {
+      recv_one( connection.recv() );
+    } catch ( NetworkException e ) {
+      if ( !network_error && !crypto_error ) {
+	network_error = e;
+      }
+    } catch ( Crypto::CryptoException e ) {
+      if ( !network_error && !crypto_error ) {
+	crypto_error = e;
+      }
+    }
+  } while ( connection.recv_pending() );
+
+  if ( network_error ) {
+    throw *network_error;
+  } else if ( crypto_error ) {
+    throw *crypto_error;
+  }
+}
+
+template <class MyState, class RemoteState>
+void Transport<MyState, RemoteState>::recv_one( string s )
+{
   Fragment frag( s );
 
   if ( fragments.add_fragment( frag ) ) { /* complete packet */
@@ -68,7 +102,7 @@ void Transport<MyState, RemoteState>::recv( void )
     sender.process_acknowledgment_through( inst.ack_num() );
 
     /* first, make sure we don't already have the new state */
-    for ( typename list< TimestampedState<RemoteState> >::iterator i = received_states.begin();
+    for ( typename list< ReceivedState<RemoteState> >::iterator i = received_states.begin();
 	  i != received_states.end();
 	  i++ ) {
       if ( inst.new_num() == i->num ) {
@@ -78,7 +112,7 @@ void Transport<MyState, RemoteState>::recv( void )
     
     /* now, make sure we do have the old state */
     bool found = 0;
-    typename list< TimestampedState<RemoteState> >::iterator reference_state = received_states.begin();
+    typename list< ReceivedState<RemoteState> >::iterator reference_state = received_states.begin();
     while ( reference_state != received_states.end() ) {
       if ( inst.old_num() == reference_state->num ) {
 	found = true;
@@ -92,19 +126,20 @@ void Transport<MyState, RemoteState>::recv( void )
       return; /* this is security-sensitive and part of how we enforce idempotency */
     }
     
-    /* apply diff to reference state */
-    TimestampedState<RemoteState> new_state = *reference_state;
-    new_state.timestamp = timestamp();
-    new_state.num = inst.new_num();
+    /* keep the diff to the reference state; it is applied when the state
+       is needed, but checked now, before the state is acknowledged */
+    ReceivedState<RemoteState> new_state( timestamp(), inst.new_num(), inst.old_num(), inst.diff(),
+					   RemoteState::check_string( inst.diff(), reference_state->shape ) );
 
-    if ( !inst.diff().empty() ) {
-      new_state.state.apply_string( inst.diff() );
+    /* the reference state is about to be thrown away, so rebuild now */
+    if ( reference_state->num < inst.throwaway_num() ) {
+      materialize( new_state );
     }
 
     process_throwaway_until( inst.throwaway_num() );
 
     /* Insert new state in sorted place */
-    for ( typename list< TimestampedState<RemoteState> >::iterator i = received_states.begin();
+    for ( typename list< ReceivedState<RemoteState> >::iterator i = received_states.begin();
 	  i != received_states.end();
 	  i++ ) {
       if ( i->num > new_state.num ) {
@@ -130,13 +165,86 @@ void Transport<MyState, RemoteState>::recv( void )
   }
 }
 
+/* Apply the diffs leading to a state, starting from a copy of the
+   nearest received state that has been materialized. The intermediate
+   states are not kept. A state whose diffs fail to apply is dropped. */
+template <class MyState, class RemoteState>
+void Transport<MyState, RemoteState>::materialize( ReceivedState<RemoteState> &s )
+{
+  if ( s.materialized ) {
+    return;
+  }
+
+  vector<const string *> diffs( 1, &s.diff );
+  uint64_t reference_num = s.reference_num;
+  const RemoteState *reference = NULL;
+
+  while ( !reference ) {
+    typename list< ReceivedState<RemoteState> >::iterator i = received_states.begin();
+    while ( (i != received_states.end()) && (i->num != reference_num) ) {
+      i++;
+    }
+    dos_assert( i != received_states.end() );
+
+    if ( i->materialized ) {
+      reference = &i->materialized->state;
+    } else {
+      diffs.push_back( &i->diff );
+      reference_num = i->reference_num;
+    }
+  }
+
+  RemoteState state( *reference );
+
+  try {
+    for ( vector<const string *>::reverse_iterator i = diffs.rbegin();
+	  i != diffs.rend();
+	  i++ ) {
+      if ( !(*i)->empty() ) {
+	state.apply_string( **i );
+      }
+    }
+  } catch ( ... ) {
+    for ( typename list< ReceivedState<RemoteState> >::iterator i = received_states.begin();
+	  i != received_states.end();
+	  i++ ) {
+      if ( &*i == &s ) {
+	received_states.erase( i );
+	break;
+      }
+    }
+    throw;
+  }
+
+  s.materialized = TimestampedState<RemoteState>( s.timestamp, s.num, state );
+  string().swap( s.diff );
+}
+
+template <class MyState, class RemoteState>
+const TimestampedState<RemoteState> & Transport<MyState, RemoteState>::get_latest_remote_state( void )
+{
+  materialize( received_states.back() );
+  return *received_states.back().materialized;
+}
+
 /* The sender uses throwaway_num to tell us the earliest received state that we need to keep around */
 template <class MyState, class RemoteState>
 void Transport<MyState, RemoteState>::process_throwaway_until( uint64_t throwaway_num )
 {
-  typename list< TimestampedState<RemoteState> >::iterator i = received_states.begin();
+  /* States refer only to older states, so going oldest first, a state
+     whose reference is being thrown away is rebuilt before the states
+     that refer to it are looked at. */
+  for ( typename list< ReceivedState<RemoteState> >::iterator i = received_states.begin();
+	i != received_states.end();
+	i++ ) {
+    if ( (i->num >= throwaway_num) && (i->reference_num < throwaway_num) ) {
+      materialize( *i );
+    }
+  }
+
+  typename list< ReceivedState<RemoteState> >::iterator i = received_states.begin();
   while ( i != received_states.end() ) {
-    typename list< TimestampedState<RemoteState> >::iterator inext = i;
+    typename list< ReceivedState<RemoteState> >::iterator inext = i;
     inext++;
     if ( i->num < throwaway_num ) {
       received_states.erase( i );
@@ -152,17 +260,24 @@ string Transport<MyState, RemoteState>::get_remote_diff( void )
 {
   /* find diff between last receiver state and current remote state, then rationalize states */
 
-  string ret( received_states.back().state.diff_from( last_receiver_state ) );
+  /* subtract() changes the states in place, so every state needs its own copy */
+  for ( typename list< ReceivedState<RemoteState> >::iterator i = received_states.begin();
+	i != received_states.end();
+	i++ ) {
+    materialize( *i );
+  }
+
+  string ret( received_states.back().materialized->state.diff_from( last_receiver_state ) );
 
-  const RemoteState *oldest_receiver_state = &received_states.front().state;
+  const RemoteState *oldest_receiver_state = &received_states.front().materialized->state;
 
-  for ( typename list< TimestampedState<RemoteState> >::reverse_iterator i = received_states.rbegin();
+  for ( typename list< ReceivedState<RemoteState> >::reverse_iterator i = received_states.rbegin();
 	i != received_states.rend();
 	i++ ) {
-    i->state.subtract( oldest_receiver_state );
+    i->materialized->state.subtract( oldest_receiver_state );
   }  
 
-  last_receiver_state = received_states.back().state;
+  last_receiver_state = received_states.back().materialized->state;
 
   return ret;
 }
@@ -42,10 +42,14 @@ namespace Network {
     TransportSender<MyState> sender;
 
     /* helper methods for recv() */
+    void recv_one( string s );
     void process_throwaway_until( uint64_t throwaway_num );
 
+    /* rebuild a received state from its nearest materialized ancestor */
+    void materialize( ReceivedState<RemoteState> &s );
+
     /* simple receiver */
-    list< TimestampedState<RemoteState> > received_states;
+    list< ReceivedState<RemoteState> > received_states;
     RemoteState last_receiver_state; /* the state we were in when user last queried state */
     FragmentAssembly fragments;
     bool verbose;
@@ -61,7 +65,7 @@ namespace Network {
     /* Returns the number of ms to wait until next possible event. */
     int wait_time( void ) { return sender.wait_time(); }
 
-    /* Blocks waiting for a packet. */
+    /* Blocks waiting for a packet, then takes in all that have arrived. */
     void recv( void );
 
     /* Find diff between last receiver state and current remote state, then rationalize states. */
@@ -86,7 +90,7 @@ namespace Network {
 
     uint64_t get_remote_state_num( void ) const { return received_states.back().num; }
 
-    const TimestampedState<RemoteState> & get_latest_remote_state( void ) const { return received_states.back(); }
+    const TimestampedState<RemoteState> & get_latest_remote_state( void );
 
     int fd( void ) const { return connection.fd(); }
 
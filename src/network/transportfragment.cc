@@ -146,6 +146,10 @@ vector<Fragment> Fragmenter::make_fragments( const Instruction &inst, int MTU )
        || (inst.protocol_version() != last_instruction.protocol_version())
        || (last_MTU != MTU) ) {
     next_instruction_id++;
+  } else {
+    /* same instruction as last time, so same fragments */
+    assert( inst.diff() == last_instruction.diff() );
+    return last_fragments;
   }
 
   if ( (inst.old_num() == last_instruction.old_num())
@@ -176,5 +180,6 @@ vector<Fragment> Fragmenter::make_fragments( const Instruction &inst, int MTU )
     ret.push_back( Fragment( next_instruction_id, fragment_num++, final, this_fragment ) );
   }
 
+  last_fragments = ret;
   return ret;
 }
@@ -81,9 +81,10 @@ namespace Network {
     uint64_t next_instruction_id;
     Instruction last_instruction;
     int last_MTU;
+    vector<Fragment> last_fragments; /* reused when the instruction is resent */
 
   public:
-    Fragmenter() : next_instruction_id( 0 ), last_instruction(), last_MTU( -1 )
+    Fragmenter() : next_instruction_id( 0 ), last_instruction(), last_MTU( -1 ), last_fragments()
     {
       last_instruction.set_old_num( -1 );
       last_instruction.set_new_num( -1 );
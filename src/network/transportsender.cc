@@ -16,16 +16,13 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <boost/lambda/lambda.hpp>
 #include <boost/typeof/typeof.hpp>
 #include <algorithm>
-#include <list>
 #include <stdio.h>
 
 #include "transportsender.h"
 #include "transportfragment.h"
 
-using namespace boost::lambda;
 using namespace Network;
 using namespace std;
 
@@ -33,8 +30,16 @@ template <class MyState>
 TransportSender<MyState>::TransportSender( Connection *s_connection, MyState &initial_state )
   : connection( s_connection ), 
     current_state( initial_state ),
-    sent_states( 1, TimestampedState<MyState>( timestamp(), 0, initial_state ) ),
-    assumed_receiver_state( sent_states.begin() ),
+    sent_states(),
+    assumed_receiver_state( 0 ),
+    diff_old_num( -1 ),
+    diff_new_num( -1 ),
+    last_diff(),
+    rationalized_known( -1 ),
+    rationalized_current( -1 ),
+    compared_current( -1 ),
+    compared_assumed( -1 ),
+    compared_equal( false ),
     fragmenter(),
     next_ack_time( timestamp() ),
     next_send_time( timestamp() ),
@@ -46,6 +51,7 @@ TransportSender<MyState>::TransportSender( Connection *s_connection, MyState &in
     SEND_MINDELAY( 15 ),
     last_heard( 0 )
 {
+  sent_states.push_back( timestamp(), 0, initial_state );
 }
 
 /* Try to send roughly two frames per RTT, bounded by limits on frame rate */
@@ -78,7 +84,7 @@ void TransportSender<MyState>::calculate_timers( void )
     next_ack_time = now + ACK_DELAY;
   }
 
-  if ( ( !(current_state == assumed_receiver_state->state)
+  if ( ( !current_state_is_assumed()
 	 && (last_heard + ACTIVE_RETRY_TIMEOUT > now) )
        || !(current_state == sent_states.back().state) ) { /* pending data to send */
     if ( next_send_time > now + SEND_MINDELAY ) {
@@ -140,8 +146,16 @@ void TransportSender<MyState>::tick( void )
   }
 
   /* Determine if a new diff or empty ack needs to be sent */
-    
-  string diff = current_state.diff_from( assumed_receiver_state->state );
+
+  string diff;
+  if ( (assumed_receiver().num == diff_old_num)
+       && (sent_states.back().num == diff_new_num)
+       && (current_state == sent_states.back().state) ) {
+    /* resending the last diff */
+    diff = last_diff;
+  } else {
+    diff = current_state.diff_from( assumed_receiver().state );
+  }
 
   if ( diff.empty() && (now >= next_ack_time) ) {
     send_empty_ack();
@@ -179,12 +193,16 @@ void TransportSender<MyState>::send_empty_ack( void )
 template <class MyState>
 void TransportSender<MyState>::add_sent_state( uint64_t the_timestamp, uint64_t num, MyState &state )
 {
-  sent_states.push_back( TimestampedState<MyState>( the_timestamp, num, state ) );
-  if ( sent_states.size() > 32 ) { /* limit on state queue */
-    BOOST_AUTO( last, sent_states.end() );
-    for ( int i = 0; i < 16; i++ ) { last--; }
-    sent_states.erase( last ); /* erase state from middle of queue */
+  if ( sent_states.size() == StateQueue<MyState>::CAPACITY ) { /* limit on state queue */
+    /* erase state from middle of queue, 16th from the end once the new state is added */
+    int middle = sent_states.size() - 15;
+    sent_states.erase( middle );
+    if ( assumed_receiver_state >= middle ) {
+      assumed_receiver_state--;
+    }
   }
+
+  sent_states.push_back( the_timestamp, num, state );
 }
 
 template <class MyState>
@@ -208,12 +226,15 @@ void TransportSender<MyState>::send_to_receiver( string diff )
     add_sent_state( timestamp(), new_num, current_state );
   }
 
+  diff_old_num = assumed_receiver().num;
+  diff_new_num = new_num;
+  last_diff = diff;
+
   send_in_fragments( diff, new_num ); // Can throw NetworkException
 
   /* successfully sent, probably */
   /* ("probably" because the FIRST size-exceeded datagram doesn't get an error) */
-  assumed_receiver_state = sent_states.end();
-  assumed_receiver_state--;
+  assumed_receiver_state = sent_states.size() - 1;
   next_ack_time = timestamp() + ACK_INTERVAL;
   next_send_time = uint64_t(-1);
 }
@@ -225,22 +246,35 @@ void TransportSender<MyState>::update_assumed_receiver_state( void )
 
   /* start from what is known and give benefit of the doubt to unacknowledged states
      transmitted recently enough ago */
-  assumed_receiver_state = sent_states.begin();
+  assumed_receiver_state = 0;
 
-  typename list< TimestampedState<MyState> >::iterator i = sent_states.begin();
-  i++;
+  /* timestamps never decrease along the queue, so if the oldest
+     unacknowledged state is recent enough, all of them are */
+  if ( sent_states.size() > 1 ) {
+    const TimestampedState<MyState> &oldest = sent_states.at( 1 );
+    assert( now >= oldest.timestamp );
 
-  while ( i != sent_states.end() ) {
-    assert( now >= i->timestamp );
-
-    if ( uint64_t(now - i->timestamp) < connection->timeout() + ACK_DELAY ) {
-      assumed_receiver_state = i;
-    } else {
-      return;
+    if ( uint64_t(now - oldest.timestamp) < connection->timeout() + ACK_DELAY ) {
+      assumed_receiver_state = sent_states.size() - 1;
     }
+  }
+}
+
+/* Compare the current state with the assumed receiver state only if
+   one of them has been modified since the last time */
+template <class MyState>
+bool TransportSender<MyState>::current_state_is_assumed( void )
+{
+  const MyState &assumed = assumed_receiver().state;
 
-    i++;
+  if ( (current_state.get_modification() != compared_current)
+       || (assumed.get_modification() != compared_assumed) ) {
+    compared_equal = (current_state == assumed);
+    compared_current = current_state.get_modification();
+    compared_assumed = assumed.get_modification();
   }
+
+  return compared_equal;
 }
 
 template <class MyState>
@@ -248,13 +282,21 @@ void TransportSender<MyState>::rationalize_states( void )
 {
   const MyState * known_receiver_state = &sent_states.front().state;
 
+  /* the sent states were rationalized as they were added, so there is
+     only work to do when the known or the current state has changed */
+  if ( (known_receiver_state->get_modification() == rationalized_known)
+       && (current_state.get_modification() == rationalized_current) ) {
+    return;
+  }
+
   current_state.subtract( known_receiver_state );
 
-  for ( typename list< TimestampedState<MyState> >::reverse_iterator i = sent_states.rbegin();
-	i != sent_states.rend();
-	i++ ) {
-    i->state.subtract( known_receiver_state );
+  for ( int i = sent_states.size() - 1; i >= 0; i-- ) {
+    sent_states.at( i ).state.subtract( known_receiver_state );
   }
+
+  rationalized_known = known_receiver_state->get_modification();
+  rationalized_current = current_state.get_modification();
 }
 
 template <class MyState>
@@ -263,7 +305,7 @@ void TransportSender<MyState>::send_in_fragments( string diff, uint64_t new_num
   Instruction inst;
 
   inst.set_protocol_version( MOSH_PROTOCOL_VERSION );
-  inst.set_old_num( assumed_receiver_state->num );
+  inst.set_old_num( assumed_receiver().num );
   inst.set_new_num( new_num );
   inst.set_ack_num( ack_num );
   inst.set_throwaway_num( sent_states.front().num );
@@ -275,9 +317,15 @@ void TransportSender<MyState>::send_in_fragments( string diff, uint64_t new_num
 
   vector<Fragment> fragments = fragmenter.make_fragments( inst, connection->get_MTU() );
 
+  vector<string> payloads;
+  payloads.reserve( fragments.size() );
   for ( BOOST_AUTO( i, fragments.begin() ); i != fragments.end(); i++ ) {
-    connection->send( i->tostring() );
+    payloads.push_back( i->tostring() );
+  }
+
+  connection->send_batch( payloads );
 
+  for ( BOOST_AUTO( i, fragments.begin() ); i != fragments.end(); i++ ) {
     if ( verbose ) {
       fprintf( stderr, "[%u] Sent [%d=>%d] id %d, frag %d ack=%d, throwaway=%d, len=%d, frame rate=%.2f, timeout=%d, srtt=%.1f\n",
 	       (unsigned int)(timestamp() % 100000), (int)inst.old_num(), (int)inst.new_num(), (int)i->id, (int)i->fragment_num,
@@ -296,12 +344,17 @@ void TransportSender<MyState>::process_acknowledgment_through( uint64_t ack_num
 {
   /* Ignore ack if we have culled the state it's acknowledging */
 
-  if ( sent_states.end() != find_if( sent_states.begin(), sent_states.end(),
-				     (&_1)->*&TimestampedState<MyState>::num == ack_num ) ) {
-    sent_states.remove_if( (&_1)->*&TimestampedState<MyState>::num < ack_num );
+  int acked = sent_states.lower_bound( ack_num );
+  if ( (acked < sent_states.size()) && (sent_states.at( acked ).num == ack_num) ) {
+    sent_states.pop_front( acked );
+
+    assumed_receiver_state -= acked;
+    if ( assumed_receiver_state < 0 ) {
+      assumed_receiver_state = 0;
+    }
   }
 
-  assert( !sent_states.empty() );
+  assert( sent_states.size() > 0 );
 }
 
 /* give up on getting acknowledgement for shutdown */
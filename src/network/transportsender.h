@@ -52,18 +52,35 @@ namespace Network {
     void send_empty_ack( void );
     void send_in_fragments( string diff, uint64_t new_num );
     void add_sent_state( uint64_t the_timestamp, uint64_t num, MyState &state );
+    bool current_state_is_assumed( void );
+
+    TimestampedState<MyState> & assumed_receiver( void ) { return sent_states.at( assumed_receiver_state ); }
 
     /* state of sender */
     Connection *connection;
 
     MyState current_state;
 
-    list< TimestampedState<MyState> > sent_states;
+    StateQueue<MyState> sent_states;
     /* first element: known, acknowledged receiver state */
     /* last element: last sent state */
 
     /* somewhere in the middle: the assumed state of the receiver */
-    typename list< TimestampedState<MyState> >::iterator assumed_receiver_state;
+    int assumed_receiver_state;
+
+    /* the last diff sent, from state diff_old_num to state diff_new_num,
+       kept for retransmissions of the same pair */
+    uint64_t diff_old_num, diff_new_num;
+    string last_diff;
+
+    /* modification stamps of the known receiver state and the current
+       state when they were last rationalized */
+    uint64_t rationalized_known, rationalized_current;
+
+    /* last comparison of the current state with the assumed receiver
+       state, by the modification stamps of the two */
+    uint64_t compared_current, compared_assumed;
+    bool compared_equal;
 
     /* for fragment creation */
     Fragmenter fragmenter;
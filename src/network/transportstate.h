@@ -19,6 +19,13 @@
 #ifndef TRANSPORT_STATE_HPP
 #define TRANSPORT_STATE_HPP
 
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <stdint.h>
+#include <boost/optional.hpp>
+#include <boost/utility/in_place_factory.hpp>
+
 namespace Network {
   template <class State>
   class TimestampedState
@@ -28,10 +35,150 @@ namespace Network {
     uint64_t num;
     State state;
     
-    TimestampedState( uint64_t s_timestamp, uint64_t s_num, State &s_state )
+    TimestampedState( uint64_t s_timestamp, uint64_t s_num, const State &s_state )
       : timestamp( s_timestamp ), num( s_num ), state( s_state )
     {}
   };
+
+  /* A state from the other side, kept as the diff from its reference
+     state until someone needs to look at it. Only states that have
+     been looked at (or are needed to rebuild others) hold a copy. */
+  template <class State>
+  class ReceivedState
+  {
+  public:
+    uint64_t timestamp;
+    uint64_t num;
+
+    uint64_t reference_num;
+    std::string diff;
+
+    /* what the next diff is checked against when it arrives */
+    typename State::Shape shape;
+
+    boost::optional< TimestampedState<State> > materialized;
+
+    ReceivedState( uint64_t s_timestamp, uint64_t s_num,
+		   uint64_t s_reference_num, const std::string &s_diff,
+		   const typename State::Shape &s_shape )
+      : timestamp( s_timestamp ), num( s_num ),
+	reference_num( s_reference_num ), diff( s_diff ),
+	shape( s_shape ), materialized()
+    {}
+
+    ReceivedState( uint64_t s_timestamp, uint64_t s_num, const State &s_state )
+      : timestamp( s_timestamp ), num( s_num ),
+	reference_num( s_num ), diff(), shape( s_state.get_shape() ),
+	materialized( TimestampedState<State>( s_timestamp, s_num, s_state ) )
+    {}
+  };
+
+  /* A bounded queue of states in order of their numbers, oldest first.
+     The states are built in a fixed set of slots, and the queue is a
+     ring of slot indices, so nothing is allocated for the queue itself
+     and a state can be removed from the middle by moving indices. */
+  template <class State>
+  class StateQueue
+  {
+  public:
+    static const int CAPACITY = 32;
+
+  private:
+    boost::optional< TimestampedState<State> > slots[ CAPACITY ];
+    std::vector<int> free_slots;
+
+    int ring[ CAPACITY ];
+    int head, count;
+
+    int ring_index( int i ) const { return (head + i) % CAPACITY; }
+
+  public:
+    StateQueue()
+      : slots(), free_slots(), ring(), head( 0 ), count( 0 )
+    {
+      for ( int i = CAPACITY - 1; i >= 0; i-- ) {
+	free_slots.push_back( i );
+      }
+    }
+
+    int size( void ) const { return count; }
+
+    TimestampedState<State> & at( int i )
+    {
+      assert( (0 <= i) && (i < count) );
+      return *slots[ ring[ ring_index( i ) ] ];
+    }
+
+    const TimestampedState<State> & at( int i ) const
+    {
+      assert( (0 <= i) && (i < count) );
+      return *slots[ ring[ ring_index( i ) ] ];
+    }
+
+    TimestampedState<State> & front( void ) { return at( 0 ); }
+    const TimestampedState<State> & front( void ) const { return at( 0 ); }
+    TimestampedState<State> & back( void ) { return at( count - 1 ); }
+    const TimestampedState<State> & back( void ) const { return at( count - 1 ); }
+
+    void push_back( uint64_t timestamp, uint64_t num, const State &state )
+    {
+      assert( count < CAPACITY );
+      int slot = free_slots.back();
+      free_slots.pop_back();
+
+      slots[ slot ] = boost::in_place( timestamp, num, state );
+      ring[ ring_index( count ) ] = slot;
+      count++;
+    }
+
+    /* remove the n oldest states */
+    void pop_front( int n )
+    {
+      assert( (0 <= n) && (n <= count) );
+      for ( int i = 0; i < n; i++ ) {
+	release( ring[ ring_index( i ) ] );
+      }
+      head = ring_index( n );
+      count -= n;
+    }
+
+    void erase( int i )
+    {
+      assert( (0 <= i) && (i < count) );
+      release( ring[ ring_index( i ) ] );
+      for ( int j = i; j < count - 1; j++ ) {
+	ring[ ring_index( j ) ] = ring[ ring_index( j + 1 ) ];
+      }
+      count--;
+    }
+
+    /* position of the oldest state numbered at least num, or size() */
+    int lower_bound( uint64_t num ) const
+    {
+      int low = 0, high = count;
+      while ( low < high ) {
+	int mid = (low + high) / 2;
+	if ( at( mid ).num < num ) {
+	  low = mid + 1;
+	} else {
+	  high = mid;
+	}
+      }
+      return low;
+    }
+
+  private:
+    /* drop the slot's state so that it doesn't hold on to anything */
+    void release( int slot )
+    {
+      slots[ slot ] = boost::none;
+      free_slots.push_back( slot );
+    }
+
+    /* nonexistent methods to satisfy -Weffc++ */
+    StateQueue( const StateQueue &x );
+    StateQueue & operator=( const StateQueue &x );
+  };
 }
 
 #endif
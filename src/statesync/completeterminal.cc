@@ -18,8 +18,10 @@
 
 #include <boost/typeof/typeof.hpp>
 #include <boost/lambda/lambda.hpp>
+#include <map>
 
 #include "completeterminal.h"
+#include "dos_assert.h"
 
 #include "hostinput.pb.h"
 
@@ -31,30 +33,373 @@ using namespace boost::lambda;
 
 string Complete::act( const string &str )
 {
-  for ( unsigned int i = 0; i < str.size(); i++ ) {
-    /* parse octet into up to three actions */
-    list<Action *> actions( parser.input( str[ i ] ) );
-    
-    /* apply actions to terminal and delete them */
-    for ( list<Action *>::iterator it = actions.begin();
-	  it != actions.end();
-	  it++ ) {
-      Action *act = *it;
-      act->act_on_terminal( &terminal );
-      delete act;
-    }
-  }
+  modification.touch();
+
+  /* parse octets into actions */
+  parser.input( str.data(), str.size(), actions );
+
+  /* apply actions to terminal */
+  terminal.act( actions );
+  actions.clear();
 
   return terminal.read_octets_to_host();
 }
 
 string Complete::act( const Action *act )
 {
+  modification.touch();
+
   /* apply action to terminal */
   act->act_on_terminal( &terminal );
   return terminal.read_octets_to_host();
 }
 
+/* renditions as packed in the protocol */
+static uint32_t pack_renditions( const Renditions &r )
+{
+  return r.get_foreground_color() | (r.get_background_color() << 8) | (r.get_attributes() << 16);
+}
+
+static Renditions unpack_renditions( uint32_t x )
+{
+  Renditions r( (x >> 8) & 0xFF );
+  r.set_foreground_color( x & 0xFF );
+  for ( int i = 0; i < Renditions::SIZE; i++ ) {
+    r.set_attribute( Renditions::attribute_type( i ), (x >> (16 + i)) & 1 );
+  }
+  return r;
+}
+
+/* a cell that is just one narrow character needs no layout */
+static bool simple_cell( const Cell &cell )
+{
+  return (!cell.empty()) && (!cell.wide) && (!cell.fallback) && (cell.char_count() == 1);
+}
+
+static bool clear_cell( const Cell &cell )
+{
+  return cell.empty() && (!cell.wide) && (!cell.fallback);
+}
+
+/* unchanged cells worth sending to avoid starting a new run */
+static const int RUN_GAP = 8;
+
+static void encode_run( int y, int start, int end, const Row &row, ScreenDiff *diff )
+{
+  CellRun *run = diff->add_run();
+  run->set_row( y );
+  run->set_col( start );
+
+  uint32_t renditions = pack_renditions( row.cells[ start ].renditions );
+  if ( renditions ) {
+    run->set_renditions( renditions );
+  }
+
+  int text_end = end;
+  while ( (text_end > start) && clear_cell( row.cells[ text_end - 1 ] ) ) {
+    text_end--;
+  }
+
+  bool simple = true;
+  for ( int x = start; x < text_end; x++ ) {
+    if ( !simple_cell( row.cells[ x ] ) ) {
+      simple = false;
+      break;
+    }
+  }
+
+  if ( text_end > start ) {
+    string *text = run->mutable_text();
+    for ( int x = start; x < text_end; x++ ) {
+      const Cell &cell = row.cells[ x ];
+      text->append( cell.get_contents() );
+      if ( !simple ) {
+	run->add_layout( (cell.get_contents().size() << 2) | (cell.wide << 1) | cell.fallback );
+      }
+    }
+  }
+
+  if ( end > text_end ) {
+    run->set_clear( end - text_end );
+  }
+}
+
+/* send the cells in [start, end) of a row that differ from the reference row */
+static void encode_row( int y, int start, int end, const Row &row, const Row &ref, ScreenDiff *diff )
+{
+  int x = start;
+  while ( x < end ) {
+    if ( row.cells[ x ] == ref.cells[ x ] ) {
+      x++;
+      continue;
+    }
+
+    /* extend the run over cells with the same renditions, and end it
+       where text resumes after empty cells so that the run stays simple */
+    const Renditions &renditions = row.cells[ x ].renditions;
+    int last_changed = x;
+    for ( int col = x + 1;
+	  (col < end) && (col - last_changed <= RUN_GAP)
+	    && (row.cells[ col ].renditions == renditions);
+	  col++ ) {
+      if ( row.cells[ col - 1 ].empty() && (!row.cells[ col ].empty())
+	   && !( (col - 2 >= x) && row.cells[ col - 2 ].wide ) ) {
+	break;
+      }
+      if ( !(row.cells[ col ] == ref.cells[ col ]) ) {
+	last_changed = col;
+      }
+    }
+
+    encode_run( y, x, last_changed + 1, row, diff );
+    x = last_changed + 1;
+  }
+}
+
+static void encode_screen( const Framebuffer &last, const Framebuffer &f, ScreenDiff *diff )
+{
+  const int width = f.ds.get_width(), height = f.ds.get_height();
+  const bool resized = (last.ds.get_width() != width) || (last.ds.get_height() != height);
+  const Row blank( width, 0 );
+
+  /* where does each row come from? After a resize, only blank rows are
+     known to match between the two ends. */
+  vector<int> source( height );
+  bool moved = resized;
+  map<uint64_t, int> last_rows;
+
+  for ( int y = 0; y < height; y++ ) {
+    source[ y ] = resized ? -1 : y;
+
+    const Row *row = f.get_row( y );
+    if ( resized || (*row == *last.get_row( y )) ) {
+      continue;
+    }
+
+    /* look for the same row elsewhere in the last frame */
+    if ( last_rows.empty() ) {
+      for ( int i = height - 1; i >= 0; i-- ) {
+	last_rows[ last.get_row( i )->hash() ] = i;
+      }
+    }
+
+    BOOST_AUTO( found, last_rows.find( row->hash() ) );
+    if ( (found != last_rows.end()) && (*row == *last.get_row( found->second )) ) {
+      source[ y ] = found->second;
+      moved = true;
+    } else if ( *row == blank ) {
+      source[ y ] = -1;
+      moved = true;
+    }
+  }
+
+  if ( moved ) {
+    for ( int y = 0; y < height; y++ ) {
+      diff->add_row_source( source[ y ] );
+    }
+  }
+
+  for ( int y = 0; y < height; y++ ) {
+    const Row *row = f.get_row( y );
+    const Row *ref = (source[ y ] < 0) ? &blank : last.get_row( source[ y ] );
+
+    if ( *row == *ref ) {
+      continue;
+    }
+
+    if ( row->wrap != ref->wrap ) {
+      diff->add_wrap_toggle( y );
+    }
+
+    /* only visit the columns that changed since the last frame */
+    int start = 0, end = width;
+    if ( (source[ y ] != y) || !row->dirty_since( ref->gen, start, end ) ) {
+      start = 0;
+      end = width;
+    }
+
+    encode_row( y, start, end, *row, *ref, diff );
+  }
+
+  if ( resized
+       || (f.ds.get_cursor_row() != last.ds.get_cursor_row())
+       || (f.ds.get_cursor_col() != last.ds.get_cursor_col()) ) {
+    diff->set_cursor_row( f.ds.get_cursor_row() );
+    diff->set_cursor_col( f.ds.get_cursor_col() );
+  }
+
+  if ( f.ds.cursor_visible != last.ds.cursor_visible ) {
+    diff->set_cursor_visible( f.ds.cursor_visible );
+  }
+
+  if ( !(f.ds.get_renditions() == last.ds.get_renditions()) ) {
+    diff->set_renditions( pack_renditions( f.ds.get_renditions() ) );
+  }
+
+  if ( f.ds.reverse_video != last.ds.reverse_video ) {
+    diff->set_reverse_video( f.ds.reverse_video );
+  }
+
+  if ( f.get_bell_count() != last.get_bell_count() ) {
+    diff->set_bell_count( f.get_bell_count() );
+  }
+
+  if ( f.get_window_title() != last.get_window_title() ) {
+    WindowTitle *title = diff->mutable_window_title();
+    const deque<wchar_t> &window_title( f.get_window_title() );
+    for ( BOOST_AUTO( i, window_title.begin() ); i != window_title.end(); i++ ) {
+      title->add_character( *i );
+    }
+  }
+}
+
+static void set_cell( Cell &cell, const Renditions &renditions, bool wide, bool fallback,
+		      const string &text, size_t pos, size_t len )
+{
+  cell.set_contents( text, pos, len );
+  cell.renditions = renditions;
+  cell.wide = wide;
+  cell.fallback = fallback;
+}
+
+/* length of the cell starting at pos in a run without layout: one
+   character and the continuation bytes after it */
+static size_t cell_length( const string &text, size_t pos )
+{
+  size_t len = 1;
+  while ( (pos + len < text.size()) && ((text[ pos + len ] & 0xC0) == 0x80) ) {
+    len++;
+  }
+  return len;
+}
+
+/* number of cells a run covers, not counting the clear */
+static int run_cells( const CellRun &run )
+{
+  if ( run.layout_size() ) {
+    return run.layout_size();
+  }
+
+  int count = 0;
+  for ( size_t pos = 0; pos < run.text().size(); pos += cell_length( run.text(), pos ) ) {
+    count++;
+  }
+  return count;
+}
+
+/* The diff comes from the other side, so it is checked as it would be
+   on the wire before anything is applied. */
+static void check_run( const CellRun &run, int width, int height )
+{
+  if ( run.layout_size() ) {
+    size_t total = 0;
+    for ( int i = 0; i < run.layout_size(); i++ ) {
+      size_t len = run.layout( i ) >> 2;
+      dos_assert( len <= run.text().size() - total );
+      total += len;
+    }
+    dos_assert( total == run.text().size() );
+  }
+
+  const int count = run_cells( run );
+
+  dos_assert( (0 <= run.row()) && (run.row() < height) );
+  dos_assert( (0 <= run.col()) && (run.col() <= width) );
+  dos_assert( count <= width - run.col() );
+  dos_assert( (0 <= run.clear()) && (run.clear() <= width - run.col() - count) );
+}
+
+static void check_screen( const ScreenDiff &diff, int width, int height )
+{
+  if ( diff.row_source_size() ) {
+    dos_assert( diff.row_source_size() == height );
+    for ( int i = 0; i < diff.row_source_size(); i++ ) {
+      dos_assert( (-1 <= diff.row_source( i )) && (diff.row_source( i ) < height) );
+    }
+  }
+
+  for ( int i = 0; i < diff.wrap_toggle_size(); i++ ) {
+    dos_assert( (0 <= diff.wrap_toggle( i )) && (diff.wrap_toggle( i ) < height) );
+  }
+
+  for ( int i = 0; i < diff.run_size(); i++ ) {
+    check_run( diff.run( i ), width, height );
+  }
+}
+
+static void apply_run( const CellRun &run, Framebuffer &fb )
+{
+  const Renditions renditions( unpack_renditions( run.renditions() ) );
+  const string &text = run.text();
+  const int count = run_cells( run );
+
+  assert( run.col() + count + run.clear() <= fb.ds.get_width() );
+
+  Row *row = fb.get_mutable_row( run.row(), run.col(), run.col() + count + run.clear() );
+  int col = run.col();
+  size_t pos = 0;
+
+  if ( run.layout_size() ) {
+    for ( int i = 0; i < run.layout_size(); i++ ) {
+      uint32_t layout = run.layout( i );
+      size_t len = layout >> 2;
+      set_cell( row->cells[ col++ ], renditions, layout & 2, layout & 1, text, pos, len );
+      pos += len;
+    }
+  } else {
+    while ( pos < text.size() ) {
+      size_t len = cell_length( text, pos );
+      set_cell( row->cells[ col++ ], renditions, false, false, text, pos, len );
+      pos += len;
+    }
+  }
+
+  for ( int i = 0; i < run.clear(); i++ ) {
+    set_cell( row->cells[ col++ ], renditions, false, false, text, 0, 0 );
+  }
+}
+
+static void apply_screen( const ScreenDiff &diff, Framebuffer &fb )
+{
+  check_screen( diff, fb.ds.get_width(), fb.ds.get_height() );
+
+  if ( diff.row_source_size() ) {
+    fb.reorder_rows( vector<int>( diff.row_source().begin(), diff.row_source().end() ) );
+  }
+
+  for ( int i = 0; i < diff.wrap_toggle_size(); i++ ) {
+    Row *row = fb.get_mutable_row( diff.wrap_toggle( i ) );
+    row->wrap = !row->wrap;
+  }
+
+  for ( int i = 0; i < diff.run_size(); i++ ) {
+    apply_run( diff.run( i ), fb );
+  }
+
+  if ( diff.has_cursor_row() ) {
+    fb.ds.move_row( diff.cursor_row() );
+  }
+  if ( diff.has_cursor_col() ) {
+    fb.ds.move_col( diff.cursor_col() );
+  }
+  if ( diff.has_cursor_visible() ) {
+    fb.ds.cursor_visible = diff.cursor_visible();
+  }
+  if ( diff.has_renditions() ) {
+    fb.ds.set_renditions( unpack_renditions( diff.renditions() ) );
+  }
+  if ( diff.has_reverse_video() ) {
+    fb.ds.reverse_video = diff.reverse_video();
+  }
+  if ( diff.has_bell_count() ) {
+    fb.set_bell_count( diff.bell_count() );
+  }
+  if ( diff.has_window_title() ) {
+    const WindowTitle &title = diff.window_title();
+    fb.set_window_title( deque<wchar_t>( title.character().begin(), title.character().end() ) );
+  }
+}
+
 /* interface for Network::Transport */
 string Complete::diff_from( const Complete &existing ) const
 {
@@ -74,21 +419,47 @@ string Complete::diff_from( const Complete &existing ) const
       new_res->MutableExtension( resize )->set_height( terminal.get_fb().ds.get_height() );
     }
     Instruction *new_inst = output.add_instruction();
-    new_inst->MutableExtension( hostbytes )->set_hoststring( Terminal::Display::new_frame( true, existing.get_fb(), terminal.get_fb() ) );
+    encode_screen( existing.get_fb(), terminal.get_fb(), new_inst->MutableExtension( screen ) );
   }
   
   return output.SerializeAsString();
 }
 
+/* Check a diff from the server without applying it, given the shape
+   of the state it applies to, and return the shape of the result. */
+Complete::Shape Complete::check_string( const string &diff, const Shape &shape )
+{
+  HostBuffers::HostMessage input;
+  dos_assert( input.ParseFromString( diff ) );
+
+  Shape ret( shape );
+
+  for ( int i = 0; i < input.instruction_size(); i++ ) {
+    if ( input.instruction( i ).HasExtension( screen ) ) {
+      check_screen( input.instruction( i ).GetExtension( screen ), ret.first, ret.second );
+    } else if ( input.instruction( i ).HasExtension( resize ) ) {
+      const ResizeMessage &res = input.instruction( i ).GetExtension( resize );
+      dos_assert( (res.width() > 0) && (res.height() > 0) );
+      ret = Shape( res.width(), res.height() );
+    }
+  }
+
+  return ret;
+}
+
 void Complete::apply_string( string diff )
 {
   HostBuffers::HostMessage input;
-  assert( input.ParseFromString( diff ) );
+  dos_assert( input.ParseFromString( diff ) );
+
+  modification.touch();
 
   for ( int i = 0; i < input.instruction_size(); i++ ) {
     if ( input.instruction( i ).HasExtension( hostbytes ) ) {
       string terminal_to_host = act( input.instruction( i ).GetExtension( hostbytes ).hoststring() );
       assert( terminal_to_host.empty() ); /* server never interrogates client terminal */
+    } else if ( input.instruction( i ).HasExtension( screen ) ) {
+      apply_screen( input.instruction( i ).GetExtension( screen ), terminal.fb );
     } else if ( input.instruction( i ).HasExtension( resize ) ) {
       act( new Resize( input.instruction( i ).GetExtension( resize ).width(),
 		       input.instruction( i ).GetExtension( resize ).height() ) );
@@ -103,6 +474,10 @@ void Complete::apply_string( string diff )
 bool Complete::operator==( Complete const &x ) const
 {
   //  assert( parser == x.parser ); /* parser state is irrelevant for us */
+  if ( modification.get() == x.modification.get() ) {
+    return true;
+  }
+
   return (terminal == x.terminal) && (echo_ack == x.echo_ack);
 }
 
@@ -121,6 +496,7 @@ bool Complete::set_echo_ack( uint64_t now )
 
   if ( echo_ack != newest_echo_ack ) {
     ret = true;
+    modification.touch();
   }
 
   echo_ack = newest_echo_ack;
@@ -20,10 +20,12 @@
 #define COMPLETE_TERMINAL_HPP
 
 #include <list>
+#include <utility>
 #include <stdint.h>
 
 #include "parser.h"
 #include "terminal.h"
+#include "modification_stamp.h"
 
 /* This class represents the complete terminal -- a UTF8Parser feeding Actions to an Emulator. */
 
@@ -33,14 +35,19 @@ namespace Terminal {
     Parser::UTF8Parser parser;
     Terminal::Emulator terminal;
 
+    Parser::HostActions actions; /* reused to avoid allocation */
+
     std::list< std::pair<uint64_t, uint64_t> > input_history;
     uint64_t echo_ack;
 
     static const int ECHO_TIMEOUT = 50; /* for late ack */
 
+    ModificationStamp modification;
+
   public:
-    Complete( size_t width, size_t height ) : parser(), terminal( width, height ),
-					      input_history(), echo_ack( 0 ) {}
+    Complete( size_t width, size_t height ) : parser(), terminal( width, height ), actions(),
+					      input_history(), echo_ack( 0 ),
+					      modification() {}
     
     std::string act( const std::string &str );
     std::string act( const Parser::Action *act );
@@ -53,7 +60,12 @@ namespace Terminal {
     void register_input_frame( uint64_t n, uint64_t now );
     int wait_time( uint64_t now ) const;
 
+    uint64_t get_modification( void ) const { return modification.get(); }
+
     /* interface for Network::Transport */
+    typedef std::pair<int, int> Shape; /* screen width and height */
+    Shape get_shape( void ) const { return Shape( get_fb().ds.get_width(), get_fb().ds.get_height() ); }
+    static Shape check_string( const std::string &diff, const Shape &shape );
     void subtract( const Complete * ) {}
     std::string diff_from( const Complete &existing ) const;
     void apply_string( std::string diff );
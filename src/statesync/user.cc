@@ -20,6 +20,7 @@
 #include <typeinfo>
 
 #include "user.h"
+#include "dos_assert.h"
 #include "userinput.pb.h"
 
 using namespace Parser;
@@ -28,6 +29,10 @@ using namespace ClientBuffers;
 
 void UserStream::subtract( const UserStream *prefix )
 {
+  if ( !prefix->actions.empty() ) {
+    modification.touch();
+  }
+
   for ( deque<UserEvent>::const_iterator i = prefix->actions.begin();
 	i != prefix->actions.end();
 	i++ ) {
@@ -83,10 +88,19 @@ string UserStream::diff_from( const UserStream &existing ) const
   return output.SerializeAsString();
 }
 
+UserStream::Shape UserStream::check_string( const string &diff, const Shape &shape )
+{
+  ClientBuffers::UserMessage input;
+  dos_assert( input.ParseFromString( diff ) );
+  return shape;
+}
+
 void UserStream::apply_string( string diff )
 {
   ClientBuffers::UserMessage input;
-  assert( input.ParseFromString( diff ) );
+  dos_assert( input.ParseFromString( diff ) );
+
+  modification.touch();
 
   for ( int i = 0; i < input.instruction_size(); i++ ) {
     if ( input.instruction( i ).HasExtension( keystroke ) ) {
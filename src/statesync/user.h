@@ -23,8 +23,10 @@
 #include <list>
 #include <string>
 #include <assert.h>
+#include <stdint.h>
 
 #include "parseraction.h"
+#include "modification_stamp.h"
 
 using std::deque;
 using std::list;
@@ -61,22 +63,29 @@ namespace Network {
   {
   private:
     deque<UserEvent> actions;
+
+    ModificationStamp modification;
     
   public:
-    UserStream() : actions() {}
+    UserStream() : actions(), modification() {}
     
-    void push_back( Parser::UserByte s_userbyte ) { actions.push_back( UserEvent( s_userbyte ) ); }
-    void push_back( Parser::Resize s_resize ) { actions.push_back( UserEvent( s_resize ) ); }
+    void push_back( Parser::UserByte s_userbyte ) { actions.push_back( UserEvent( s_userbyte ) ); modification.touch(); }
+    void push_back( Parser::Resize s_resize ) { actions.push_back( UserEvent( s_resize ) ); modification.touch(); }
     
     bool empty( void ) const { return actions.empty(); }
     size_t size( void ) const { return actions.size(); }
     const Parser::Action *get_action( unsigned int i );
     
     /* interface for Network::Transport */
+    typedef int Shape; /* user input is checked only for parsing */
+    Shape get_shape( void ) const { return 0; }
+    static Shape check_string( const string &diff, const Shape &shape );
     void subtract( const UserStream *prefix );
     string diff_from( const UserStream &existing ) const;
     void apply_string( string diff );
-    bool operator==( const UserStream &x ) const { return actions == x.actions; }
+    bool operator==( const UserStream &x ) const { return (modification.get() == x.modification.get()) || (actions == x.actions); }
+
+    uint64_t get_modification( void ) const { return modification.get(); }
   };
 }
 
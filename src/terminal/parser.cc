@@ -17,122 +17,136 @@
 */
 
 #include <assert.h>
-#include <typeinfo>
-#include <langinfo.h>
-#include <errno.h>
 
 #include "parser.h"
 
-static void append_or_delete( Parser::Action *act,
-			      std::list<Parser::Action *>&vec )
+static const Parser::TransitionTable transitions;
+
+void Parser::Parser::input( wchar_t ch, HostActions &ret )
 {
-  assert( act );
+  unsigned char tx = transitions.get( state, ch );
+  State next_state = TransitionTable::next_state( tx );
+  ActionType action = TransitionTable::action( tx );
+
+  /* a transition to the same state still runs its exit and entry actions */
+  if ( next_state != NO_STATE ) {
+    ActionType exit_action = transitions.exit( state );
+    if ( exit_action != IGNORE ) {
+      ret.push_back( HostAction( exit_action ) );
+    }
+  }
 
-  if ( typeid( *act ) != typeid( Parser::Ignore ) ) {
-    vec.push_back( act );
-  } else {
-    delete act;
+  if ( action != IGNORE ) {
+    ret.push_back( HostAction( action, ch ) );
   }
-}
 
-std::list<Parser::Action *> Parser::Parser::input( wchar_t ch )
-{
-  std::list<Action *> ret;
+  if ( next_state != NO_STATE ) {
+    ActionType enter_action = transitions.enter( next_state );
+    if ( enter_action != IGNORE ) {
+      ret.push_back( HostAction( enter_action ) );
+    }
+    state = next_state;
+  }
+}
 
-  Transition tx = state->input( ch );
+Parser::UTF8Parser::UTF8Parser()
+  : parser(), code_point( 0 ), bytes_needed( 0 ), next_min( 0x80 ), next_max( 0xBF )
+{}
 
-  if ( tx.next_state != NULL ) {
-    append_or_delete( state->exit(), ret );
+/* length of the run of ASCII bytes at the start of s */
+static size_t ascii_run( const char *s, size_t len )
+{
+  size_t i = 0;
+
+  /* test eight bytes at a time for a set high bit */
+  while ( i + sizeof( uint64_t ) <= len ) {
+    uint64_t word;
+    memcpy( &word, s + i, sizeof( word ) );
+    if ( word & 0x8080808080808080ULL ) {
+      break;
+    }
+    i += sizeof( word );
   }
 
-  append_or_delete( tx.action, ret );
-
-  if ( tx.next_state != NULL ) {
-    append_or_delete( tx.next_state->enter(), ret );
-    state = tx.next_state;
+  while ( (i < len) && !(s[ i ] & 0x80) ) {
+    i++;
   }
 
-  return ret;
+  return i;
 }
 
-Parser::UTF8Parser::UTF8Parser()
-  : parser(), buf_len( 0 )
+void Parser::UTF8Parser::input( const char *s, size_t len, HostActions &ret )
 {
-  assert( BUF_SIZE >= MB_CUR_MAX );
+  size_t i = 0;
+
+  while ( i < len ) {
+    if ( bytes_needed == 0 ) {
+      /* ASCII goes straight to the parser */
+      size_t run = ascii_run( s + i, len - i );
+      for ( size_t j = i; j < i + run; j++ ) {
+	parser.input( (wchar_t)s[ j ], ret );
+      }
+      i += run;
+      if ( i == len ) {
+	break;
+      }
+    }
+
+    decode( s[ i++ ], ret );
+  }
 }
 
-std::list<Parser::Action *> Parser::UTF8Parser::input( char c )
+void Parser::UTF8Parser::decode( unsigned char c, HostActions &ret )
 {
-  assert( buf_len < BUF_SIZE );
-
-  buf[ buf_len++ ] = c;
-
-  /* This function will only work in a UTF-8 locale. */
-  /* This is asserted in the constructor. */
-
-  wchar_t pwc;
-  mbstate_t ps;
-  memset( &ps, 0, sizeof( ps ) );
-
-  size_t total_bytes_parsed = 0;
-  size_t orig_buf_len = buf_len;
-  std::list<Action *> ret;
-
-  /* this routine is somewhat complicated in order to comply with
-     Unicode 6.0, section 3.9, "Best Practices for using U+FFFD" */
-
-  while ( total_bytes_parsed != orig_buf_len ) {
-    assert( total_bytes_parsed < orig_buf_len );
-    assert( buf_len > 0 );
-    size_t bytes_parsed = mbrtowc( &pwc, buf, buf_len, &ps );
-
-    /* this returns 0 when n = 0! */
-
-    /* This function annoying returns a size_t so we have to check
-       the negative values first before the "> 0" branch */
-
-    if ( bytes_parsed == 0 ) {
-      /* character was NUL, accept and clear buffer */
-      assert( buf_len == 1 );
-      buf_len = 0;
-      pwc = L'\0';
-      bytes_parsed = 1;
-    } else if ( bytes_parsed == (size_t) -1 ) {
-      /* invalid sequence, use replacement character and try again with last char */
-      assert( errno == EILSEQ );
-      if ( buf_len > 1 ) {
-	buf[ 0 ] = buf[ buf_len - 1 ];
-	bytes_parsed = buf_len - 1;
-	buf_len = 1;
-      } else {
-	buf_len = 0;
-	bytes_parsed = 1;
+  /* Replace each maximal ill-formed subsequence with U+FFFD, per
+     Unicode 6.0, section 3.9, "Best Practices for using U+FFFD".
+     Overlong forms, surrogates and characters beyond U+10FFFF are
+     caught by the range allowed for the first continuation byte. */
+
+  if ( bytes_needed > 0 ) {
+    if ( (next_min <= c) && (c <= next_max) ) {
+      code_point = (code_point << 6) | (c & 0x3F);
+      next_min = 0x80;
+      next_max = 0xBF;
+
+      if ( --bytes_needed == 0 ) {
+	parser.input( (wchar_t)code_point, ret );
       }
-      pwc = (wchar_t) 0xFFFD;
-    } else if ( bytes_parsed == (size_t) -2 ) {
-      /* can't parse incomplete multibyte character */
-      total_bytes_parsed += buf_len;
-      continue;
-    } else if ( bytes_parsed > 0 ) {
-      /* parsed into pwc, accept */
-      assert( bytes_parsed <= buf_len );
-      memcpy( buf, buf + bytes_parsed, buf_len - bytes_parsed );
-      buf_len = buf_len - bytes_parsed;
-    } else {
-      throw std::string( "Unknown return value from mbrtowc" );
+      return;
     }
 
-    if ( (pwc < 0) || (pwc > 0x10FFFF) ) { /* outside Unicode range */
-      pwc = (wchar_t) 0xFFFD;
-    }
-
-    std::list<Action *> vec = parser.input( pwc );
-    ret.insert( ret.end(), vec.begin(), vec.end() );
-
-    total_bytes_parsed += bytes_parsed;
+    /* truncated character; try this byte again on its own */
+    bytes_needed = 0;
+    next_min = 0x80;
+    next_max = 0xBF;
+    parser.input( (wchar_t)0xFFFD, ret );
   }
 
-  return ret;
+  if ( c < 0x80 ) {
+    parser.input( (wchar_t)c, ret );
+  } else if ( (0xC2 <= c) && (c <= 0xDF) ) {
+    code_point = c & 0x1F;
+    bytes_needed = 1;
+  } else if ( (0xE0 <= c) && (c <= 0xEF) ) {
+    code_point = c & 0x0F;
+    bytes_needed = 2;
+    if ( c == 0xE0 ) {
+      next_min = 0xA0; /* overlong */
+    } else if ( c == 0xED ) {
+      next_max = 0x9F; /* surrogates */
+    }
+  } else if ( (0xF0 <= c) && (c <= 0xF4) ) {
+    code_point = c & 0x07;
+    bytes_needed = 3;
+    if ( c == 0xF0 ) {
+      next_min = 0x90; /* overlong */
+    } else if ( c == 0xF4 ) {
+      next_max = 0x8F; /* beyond U+10FFFF */
+    }
+  } else {
+    /* continuation byte without a start byte, or a byte never used in UTF-8 */
+    parser.input( (wchar_t)0xFFFD, ret );
+  }
 }
 
 Parser::Parser::Parser( const Parser &other )
@@ -23,55 +23,55 @@
    http://www.vt100.net/emu/dec_ansi_parser */
 
 #include <wchar.h>
-#include <list>
 #include <string.h>
+#include <stdint.h>
 
-#include "parsertransition.h"
 #include "parseraction.h"
 #include "parserstate.h"
-#include "parserstatefamily.h"
 
 #ifndef __STDC_ISO_10646__
 #error "Must have __STDC_ISO_10646__"
 #endif
 
 namespace Parser {
-  static const StateFamily family;
-
   class Parser {
   private:
-    State const *state;
+    State state;
 
   public:
-    Parser() : state( &family.s_Ground ) {}
+    Parser() : state( GROUND ) {}
 
     Parser( const Parser &other );
     Parser & operator=( const Parser & );
     ~Parser() {}
 
-    std::list<Action *> input( wchar_t ch );
+    void input( wchar_t ch, HostActions &ret );
 
     bool operator==( const Parser &x ) const
     {
       return state == x.state;
     }
 
-    bool is_grounded( void ) const { return state == &family.s_Ground; }
+    bool is_grounded( void ) const { return state == GROUND; }
   };
 
-  static const size_t BUF_SIZE = 8;
-
   class UTF8Parser {
   private:
     Parser parser;
 
-    char buf[ BUF_SIZE ];
-    size_t buf_len;
+    /* state of the UTF-8 decoder, which does not depend on the locale */
+    uint32_t code_point; /* bits of the current character so far */
+    int bytes_needed; /* continuation bytes still to come */
+    unsigned char next_min, next_max; /* allowed range of the next byte */
+
+    void decode( unsigned char c, HostActions &ret );
 
   public:
     UTF8Parser();
 
-    std::list<Action *> input( char c );
+    /* parse one byte or a whole buffer, appending the actions to ret */
+    void input( char c, HostActions &ret ) { decode( c, ret ); }
+    void input( const char *s, size_t len, HostActions &ret );
 
     bool operator==( const UTF8Parser &x ) const
     {
@@ -37,54 +37,77 @@ std::string Action::str( void )
   return name() + std::string( thechar );
 }
 
-void Print::act_on_terminal( Terminal::Emulator *emu ) const
+std::string HostAction::name( void ) const
 {
-  emu->print( this );
-}
-
-void Execute::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->execute( this );
-}
-
-void Clear::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.clear( this );
-}
-
-void Param::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.newparamchar( this );
-}
-
-void Collect::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.collect( this );
-}
-
-void CSI_Dispatch::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->CSI_dispatch( this );
-}
+  switch ( type ) {
+  case IGNORE: return "Ignore";
+  case PRINT: return "Print";
+  case EXECUTE: return "Execute";
+  case CLEAR: return "Clear";
+  case COLLECT: return "Collect";
+  case PARAM: return "Param";
+  case ESC_DISPATCH: return "Esc_Dispatch";
+  case CSI_DISPATCH: return "CSI_Dispatch";
+  case HOOK: return "Hook";
+  case PUT: return "Put";
+  case UNHOOK: return "Unhook";
+  case OSC_START: return "OSC_Start";
+  case OSC_PUT: return "OSC_Put";
+  case OSC_END: return "OSC_End";
+  }
 
-void Esc_Dispatch::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->Esc_dispatch( this );
+  return "Unknown";
 }
 
-void OSC_Put::act_on_terminal( Terminal::Emulator *emu ) const
+std::string HostAction::str( void ) const
 {
-  emu->dispatch.OSC_put( this );
-}
+  char thechar[ 10 ] = { 0 };
+  if ( char_present ) {
+    if ( iswprint( ch ) )
+      snprintf( thechar, 10, "(%lc)", ch );
+    else
+      snprintf( thechar, 10, "(0x%x)", (unsigned int)ch );
+  }
 
-void OSC_Start::act_on_terminal( Terminal::Emulator *emu ) const
-{
-  emu->dispatch.OSC_start( this );
+  return name() + std::string( thechar );
 }
 
-void OSC_End::act_on_terminal( Terminal::Emulator *emu ) const
+void HostAction::act_on_terminal( Terminal::Emulator *emu ) const
 {
-  emu->OSC_end( this );
+  switch ( type ) {
+  case PRINT:
+    emu->print( this );
+    break;
+  case EXECUTE:
+    emu->execute( this );
+    break;
+  case CLEAR:
+    emu->dispatch.clear( this );
+    break;
+  case PARAM:
+    emu->dispatch.newparamchar( this );
+    break;
+  case COLLECT:
+    emu->dispatch.collect( this );
+    break;
+  case CSI_DISPATCH:
+    emu->CSI_dispatch( this );
+    break;
+  case ESC_DISPATCH:
+    emu->Esc_dispatch( this );
+    break;
+  case OSC_PUT:
+    emu->dispatch.OSC_put( this );
+    break;
+  case OSC_START:
+    emu->dispatch.OSC_start( this );
+    break;
+  case OSC_END:
+    emu->OSC_end( this );
+    break;
+  default: /* not implemented: DCS */
+    break;
+  }
 }
 
 void UserByte::act_on_terminal( Terminal::Emulator *emu ) const
@@ -20,12 +20,48 @@
 #define PARSERACTION_HPP
 
 #include <string>
+#include <vector>
 
 namespace Terminal {
   class Emulator;
 }
 
 namespace Parser {
+  /* Actions of the host-output state machine are plain tagged values,
+     collected in a reusable vector, so parsing allocates nothing. */
+  enum ActionType { IGNORE, PRINT, EXECUTE, CLEAR, COLLECT, PARAM,
+		    ESC_DISPATCH, CSI_DISPATCH, HOOK, PUT, UNHOOK,
+		    OSC_START, OSC_PUT, OSC_END };
+
+  class HostAction
+  {
+  public:
+    ActionType type;
+    bool char_present;
+    wchar_t ch;
+    mutable bool handled;
+
+    std::string name( void ) const;
+    std::string str( void ) const;
+
+    void act_on_terminal( Terminal::Emulator *emu ) const;
+
+    HostAction( ActionType s_type )
+      : type( s_type ), char_present( false ), ch( -1 ), handled( false )
+    {}
+
+    HostAction( ActionType s_type, wchar_t s_ch )
+      : type( s_type ), char_present( true ), ch( s_ch ), handled( false )
+    {}
+
+    HostAction() /* default constructor required by C++11 STL */
+      : type( IGNORE ), char_present( false ), ch( -1 ), handled( false )
+    {}
+  };
+
+  typedef std::vector<HostAction> HostActions;
+
+  /* Events that are not part of the host-output state machine */
   class Action
   {
   public:
@@ -45,69 +81,6 @@ namespace Parser {
     virtual bool operator==( const Action &other ) const;
   };
 
-  class Ignore : public Action {
-  public: std::string name( void ) { return std::string( "Ignore" ); }
-  };
-  class Print : public Action {
-  public:
-    std::string name( void ) { return std::string( "Print" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Execute : public Action {
-  public:
-    std::string name( void ) { return std::string( "Execute" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Clear : public Action {
-  public:
-    std::string name( void ) { return std::string( "Clear" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Collect : public Action {
-  public:
-    std::string name( void ) { return std::string( "Collect" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Param : public Action {
-  public:
-    std::string name( void ) { return std::string( "Param" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Esc_Dispatch : public Action {
-  public:
-    std::string name( void ) { return std::string( "Esc_Dispatch" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class CSI_Dispatch : public Action {
-  public:
-    std::string name( void ) { return std::string( "CSI_Dispatch" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class Hook : public Action {
-  public: std::string name( void ) { return std::string( "Hook" ); }
-  };
-  class Put : public Action {
-  public: std::string name( void ) { return std::string( "Put" ); }
-  };
-  class Unhook : public Action {
-  public: std::string name( void ) { return std::string( "Unhook" ); }
-  };
-  class OSC_Start : public Action {
-  public:
-    std::string name( void ) { return std::string( "OSC_Start" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class OSC_Put : public Action {
-  public:
-    std::string name( void ) { return std::string( "OSC_Put" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-  class OSC_End : public Action {
-  public:
-    std::string name( void ) { return std::string( "OSC_End" ); }
-    void act_on_terminal( Terminal::Emulator *emu ) const;
-  };
-
   class UserByte : public Action {
     /* user keystroke -- not part of the host-source state machine*/
   public:
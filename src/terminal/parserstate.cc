@@ -16,49 +16,54 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <assert.h>
+
 #include "parserstate.h"
-#include "parserstatefamily.h"
 
 using namespace Parser;
 
-Transition State::anywhere_rule( wchar_t ch ) const
+/* The rules below follow Paul Williams's state diagram. They are
+   only consulted to build the transition table. */
+
+namespace {
+  class Transition
+  {
+  public:
+    ActionType action;
+    State next_state;
+
+    Transition( ActionType s_action=IGNORE, State s_next_state=NO_STATE )
+      : action( s_action ), next_state( s_next_state )
+    {}
+
+    Transition( State s_next_state )
+      : action( IGNORE ), next_state( s_next_state )
+    {}
+  };
+}
+
+static Transition anywhere_rule( wchar_t ch )
 {
   if ( (ch == 0x18) || (ch == 0x1A)
        || ((0x80 <= ch) && (ch <= 0x8F))
        || ((0x91 <= ch) && (ch <= 0x97))
        || (ch == 0x99) || (ch == 0x9A) ) {
-    return Transition( new Execute, &family->s_Ground );
+    return Transition( EXECUTE, GROUND );
   } else if ( ch == 0x9C ) {
-    return Transition( &family->s_Ground );
+    return Transition( GROUND );
   } else if ( ch == 0x1B ) {
-    return Transition( &family->s_Escape );
+    return Transition( ESCAPE );
   } else if ( (ch == 0x98) || (ch == 0x9E) || (ch == 0x9F) ) {
-    return Transition( &family->s_SOS_PM_APC_String );
+    return Transition( SOS_PM_APC_STRING );
   } else if ( ch == 0x90 ) {
-    return Transition( &family->s_DCS_Entry );
+    return Transition( DCS_ENTRY );
   } else if ( ch == 0x9D ) {
-    return Transition( &family->s_OSC_String );
+    return Transition( OSC_STRING );
   } else if ( ch == 0x9B ) {
-    return Transition( &family->s_CSI_Entry );
-  }
-
-  return Transition( NULL, NULL ); /* don't allocate an Ignore action */
-}
-
-Transition State::input( wchar_t ch ) const
-{
-  Transition ret = anywhere_rule( ch );
-  if ( !ret.next_state ) {
-    if ( ch >= 0xA0 ) {
-      ret = this->input_state_rule( 0x41 );
-    } else {
-      ret = this->input_state_rule( ch );
-    }
+    return Transition( CSI_ENTRY );
   }
 
-  ret.action->char_present = true;
-  ret.action->ch = ch;
-  return ret;
+  return Transition();
 }
 
 static bool C0_prime( wchar_t ch )
@@ -74,32 +79,27 @@ static bool GLGR ( wchar_t ch )
 	   || ( (0xA0 <= ch) && (ch <= 0xFF) ) ); /* GR area */
 }
 
-Transition Ground::input_state_rule( wchar_t ch ) const
+static Transition Ground_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( GLGR( ch ) ) {
-    return Transition( new Print );
+    return Transition( PRINT );
   }
 
   return Transition();
 }
 
-Action *Escape::enter( void ) const
-{
-  return new Clear;
-}
-
-Transition Escape::input_state_rule( wchar_t ch ) const
+static Transition Escape_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_Escape_Intermediate );
+    return Transition( COLLECT, ESCAPE_INTERMEDIATE );
   }
 
   if ( ( (0x30 <= ch) && (ch <= 0x4F) )
@@ -108,267 +108,284 @@ Transition Escape::input_state_rule( wchar_t ch ) const
        || ( ch == 0x5A )
        || ( ch == 0x5C )
        || ( (0x60 <= ch) && (ch <= 0x7E) ) ) {
-    return Transition( new Esc_Dispatch, &family->s_Ground );
+    return Transition( ESC_DISPATCH, GROUND );
   }
 
   if ( ch == 0x5B ) {
-    return Transition( &family->s_CSI_Entry );
+    return Transition( CSI_ENTRY );
   }
 
   if ( ch == 0x5D ) {
-    return Transition( &family->s_OSC_String );
+    return Transition( OSC_STRING );
   }
 
   if ( ch == 0x50 ) {
-    return Transition( &family->s_DCS_Entry );
+    return Transition( DCS_ENTRY );
   }
 
   if ( (ch == 0x58) || (ch == 0x5E) || (ch == 0x5F) ) {
-    return Transition( &family->s_SOS_PM_APC_String );
+    return Transition( SOS_PM_APC_STRING );
   }
 
   return Transition();
 }
 
-Transition Escape_Intermediate::input_state_rule( wchar_t ch ) const
+static Transition Escape_Intermediate_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect );
+    return Transition( COLLECT );
   }
 
   if ( (0x30 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new Esc_Dispatch, &family->s_Ground );
+    return Transition( ESC_DISPATCH, GROUND );
   }
 
   return Transition();
 }
 
-Action *CSI_Entry::enter( void ) const
-{
-  return new Clear;
-}
-
-Transition CSI_Entry::input_state_rule( wchar_t ch ) const
+static Transition CSI_Entry_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new CSI_Dispatch, &family->s_Ground );
+    return Transition( CSI_DISPATCH, GROUND );
   }
 
   if ( ( (0x30 <= ch) && (ch <= 0x39) )
        || ( ch == 0x3B ) ) {
-    return Transition( new Param, &family->s_CSI_Param );
+    return Transition( PARAM, CSI_PARAM );
   }
 
   if ( (0x3C <= ch) && (ch <= 0x3F) ) {
-    return Transition( new Collect, &family->s_CSI_Param );
+    return Transition( COLLECT, CSI_PARAM );
   }
 
   if ( ch == 0x3A ) {
-    return Transition( &family->s_CSI_Ignore );
+    return Transition( CSI_IGNORE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_CSI_Intermediate );
+    return Transition( COLLECT, CSI_INTERMEDIATE );
   }
 
   return Transition();
 }
 
-Transition CSI_Param::input_state_rule( wchar_t ch ) const
+static Transition CSI_Param_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( ( (0x30 <= ch) && (ch <= 0x39) ) || ( ch == 0x3B ) ) {
-    return Transition( new Param );
+    return Transition( PARAM );
   }
 
   if ( ( ch == 0x3A ) || ( (0x3C <= ch) && (ch <= 0x3F) ) ) {
-    return Transition( &family->s_CSI_Ignore );
+    return Transition( CSI_IGNORE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_CSI_Intermediate );
+    return Transition( COLLECT, CSI_INTERMEDIATE );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new CSI_Dispatch, &family->s_Ground );
+    return Transition( CSI_DISPATCH, GROUND );
   }
 
   return Transition();
 }
 
-Transition CSI_Intermediate::input_state_rule( wchar_t ch ) const
+static Transition CSI_Intermediate_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect );
+    return Transition( COLLECT );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( new CSI_Dispatch, &family->s_Ground );
+    return Transition( CSI_DISPATCH, GROUND );
   }
 
   if ( (0x30 <= ch) && (ch <= 0x3F) ) {
-    return Transition( &family->s_CSI_Ignore );
+    return Transition( CSI_IGNORE );
   }
 
   return Transition();
 }
 
-Transition CSI_Ignore::input_state_rule( wchar_t ch ) const
+static Transition CSI_Ignore_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) ) {
-    return Transition( new Execute );
+    return Transition( EXECUTE );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( &family->s_Ground );
+    return Transition( GROUND );
   }
 
   return Transition();
 }
 
-Action *DCS_Entry::enter( void ) const
-{
-  return new Clear;
-}
-
-Transition DCS_Entry::input_state_rule( wchar_t ch ) const
+static Transition DCS_Entry_rule( wchar_t ch )
 {
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_DCS_Intermediate );
+    return Transition( COLLECT, DCS_INTERMEDIATE );
   }
 
   if ( ch == 0x3A ) {
-    return Transition( &family->s_DCS_Ignore );
+    return Transition( DCS_IGNORE );
   }
 
   if ( ( (0x30 <= ch) && (ch <= 0x39) ) || ( ch == 0x3B ) ) {
-    return Transition( new Param, &family->s_DCS_Param );
+    return Transition( PARAM, DCS_PARAM );
   }
 
   if ( (0x3C <= ch) && (ch <= 0x3F) ) {
-    return Transition( new Collect, &family->s_DCS_Param );
+    return Transition( COLLECT, DCS_PARAM );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( &family->s_DCS_Passthrough );
+    return Transition( DCS_PASSTHROUGH );
   }
 
   return Transition();
 }
 
-Transition DCS_Param::input_state_rule( wchar_t ch ) const
+static Transition DCS_Param_rule( wchar_t ch )
 {
   if ( ( (0x30 <= ch) && (ch <= 0x39) ) || ( ch == 0x3B ) ) {
-    return Transition( new Param );
+    return Transition( PARAM );
   }
 
   if ( ( ch == 0x3A ) || ( (0x3C <= ch) && (ch <= 0x3F) ) ) {
-    return Transition( &family->s_DCS_Ignore );
+    return Transition( DCS_IGNORE );
   }
 
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect, &family->s_DCS_Intermediate );
+    return Transition( COLLECT, DCS_INTERMEDIATE );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( &family->s_DCS_Passthrough );
+    return Transition( DCS_PASSTHROUGH );
   }
 
   return Transition();
 }
 
-Transition DCS_Intermediate::input_state_rule( wchar_t ch ) const
+static Transition DCS_Intermediate_rule( wchar_t ch )
 {
   if ( (0x20 <= ch) && (ch <= 0x2F) ) {
-    return Transition( new Collect );
+    return Transition( COLLECT );
   }
 
   if ( (0x40 <= ch) && (ch <= 0x7E) ) {
-    return Transition( &family->s_DCS_Passthrough );
+    return Transition( DCS_PASSTHROUGH );
   }
 
   if ( (0x30 <= ch) && (ch <= 0x3F) ) {
-    return Transition( &family->s_DCS_Ignore );
+    return Transition( DCS_IGNORE );
   }
 
   return Transition();
 }
 
-Action *DCS_Passthrough::enter( void ) const
-{
-  return new Hook;
-}
-
-Action *DCS_Passthrough::exit( void ) const
-{
-  return new Unhook;
-}
-
-Transition DCS_Passthrough::input_state_rule( wchar_t ch ) const
+static Transition DCS_Passthrough_rule( wchar_t ch )
 {
   if ( C0_prime( ch ) || ( (0x20 <= ch) && (ch <= 0x7E) ) ) {
-    return Transition( new Put );
+    return Transition( PUT );
   }
 
   if ( ch == 0x9C ) {
-    return Transition( &family->s_Ground );
+    return Transition( GROUND );
   }
 
   return Transition();
 }
 
-Transition DCS_Ignore::input_state_rule( wchar_t ch ) const
+static Transition DCS_Ignore_rule( wchar_t ch )
 {
   if ( ch == 0x9C ) {
-    return Transition( &family->s_Ground );
+    return Transition( GROUND );
   }
 
   return Transition();
 }
 
-Action *OSC_String::enter( void ) const
-{
-  return new OSC_Start;
-}
-
-Action *OSC_String::exit( void ) const
-{
-  return new OSC_End;
-}
-
-Transition OSC_String::input_state_rule( wchar_t ch ) const
+static Transition OSC_String_rule( wchar_t ch )
 {
   if ( (0x20 <= ch) && (ch <= 0x7F) ) {
-    return Transition( new OSC_Put );
+    return Transition( OSC_PUT );
   }
 
   if ( (ch == 0x9C) || (ch == 0x07) ) { /* 0x07 is xterm non-ANSI variant */
-    return Transition( &family->s_Ground );
+    return Transition( GROUND );
   }
 
   return Transition();
 }
 
-Transition SOS_PM_APC_String::input_state_rule( wchar_t ch ) const
+static Transition SOS_PM_APC_String_rule( wchar_t ch )
 {
   if ( ch == 0x9C ) {
-    return Transition( &family->s_Ground );
+    return Transition( GROUND );
   }
 
   return Transition();
 }
+
+static Transition state_rule( State state, wchar_t ch )
+{
+  switch ( state ) {
+  case GROUND: return Ground_rule( ch );
+  case ESCAPE: return Escape_rule( ch );
+  case ESCAPE_INTERMEDIATE: return Escape_Intermediate_rule( ch );
+  case CSI_ENTRY: return CSI_Entry_rule( ch );
+  case CSI_PARAM: return CSI_Param_rule( ch );
+  case CSI_INTERMEDIATE: return CSI_Intermediate_rule( ch );
+  case CSI_IGNORE: return CSI_Ignore_rule( ch );
+  case DCS_ENTRY: return DCS_Entry_rule( ch );
+  case DCS_PARAM: return DCS_Param_rule( ch );
+  case DCS_INTERMEDIATE: return DCS_Intermediate_rule( ch );
+  case DCS_PASSTHROUGH: return DCS_Passthrough_rule( ch );
+  case DCS_IGNORE: return DCS_Ignore_rule( ch );
+  case OSC_STRING: return OSC_String_rule( ch );
+  case SOS_PM_APC_STRING: return SOS_PM_APC_String_rule( ch );
+  default: assert( false ); return Transition();
+  }
+}
+
+TransitionTable::TransitionTable()
+  : table(), entry_action(), exit_action()
+{
+  for ( int state = 0; state < NUM_STATES; state++ ) {
+    for ( int ch = 0; ch < COLUMNS; ch++ ) {
+      /* the "anywhere" rule takes precedence over the state's own rules */
+      Transition tx = anywhere_rule( ch );
+      if ( tx.next_state == NO_STATE ) {
+	tx = state_rule( State( state ), ch );
+      }
+
+      table[ state ][ ch ] = (tx.next_state << 4) | tx.action;
+    }
+
+    entry_action[ state ] = exit_action[ state ] = IGNORE;
+  }
+
+  entry_action[ ESCAPE ] = CLEAR;
+  entry_action[ CSI_ENTRY ] = CLEAR;
+  entry_action[ DCS_ENTRY ] = CLEAR;
+  entry_action[ DCS_PASSTHROUGH ] = HOOK;
+  exit_action[ DCS_PASSTHROUGH ] = UNHOOK;
+  entry_action[ OSC_STRING ] = OSC_START;
+  exit_action[ OSC_STRING ] = OSC_END;
+}
@@ -16,89 +16,48 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+
 #ifndef PARSERSTATE_HPP
 #define PARSERSTATE_HPP
 
-#include "parsertransition.h"
+#include <wchar.h>
 
-namespace Parser {
-  class StateFamily;
+#include "parseraction.h"
 
-  class State
+namespace Parser {
+  enum State { GROUND, ESCAPE, ESCAPE_INTERMEDIATE,
+	       CSI_ENTRY, CSI_PARAM, CSI_INTERMEDIATE, CSI_IGNORE,
+	       DCS_ENTRY, DCS_PARAM, DCS_INTERMEDIATE, DCS_PASSTHROUGH, DCS_IGNORE,
+	       OSC_STRING, SOS_PM_APC_STRING,
+	       NUM_STATES,
+	       NO_STATE = 15 }; /* "stay in this state" in a packed transition */
+
+  /* The state machine is flattened into a table indexed by state and
+     character. Each entry packs the next state into the high nibble
+     and the action into the low nibble. Every character from 0xA0 up
+     behaves like 0x41, so the table needs only 0xA0 columns. */
+  class TransitionTable
   {
-  protected:
-    virtual Transition input_state_rule( wchar_t ch ) const = 0;
-    StateFamily *family;
-
   private:
-    Transition anywhere_rule( wchar_t ch ) const;
-
-  public:
-    void setfamily( StateFamily *s_family ) { family = s_family; }
-    Transition input( wchar_t ch ) const;
-    virtual Action *enter( void ) const { return new Ignore; }
-    virtual Action *exit( void ) const { return new Ignore; }
+    static const int COLUMNS = 0xA0;
 
-    State() : family( NULL ) {};
-    virtual ~State() {};
+    unsigned char table[ NUM_STATES ][ COLUMNS ];
+    ActionType entry_action[ NUM_STATES ];
+    ActionType exit_action[ NUM_STATES ];
 
-    State( const State & );
-    State & operator=( const State & );
-  };
-
-  class Ground : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
+  public:
+    TransitionTable(); /* build from the rules in parserstate.cc */
 
-  class Escape : public State {
-    Action *enter( void ) const;
-    Transition input_state_rule( wchar_t ch ) const;
-  };
+    unsigned char get( State state, wchar_t ch ) const
+    {
+      return table[ state ][ ((unsigned int)ch < COLUMNS) ? ch : 0x41 ];
+    }
 
-  class Escape_Intermediate : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
+    static State next_state( unsigned char packed ) { return State( packed >> 4 ); }
+    static ActionType action( unsigned char packed ) { return ActionType( packed & 0x0F ); }
 
-  class CSI_Entry : public State {
-    Action *enter( void ) const;
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-  class CSI_Param : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-  class CSI_Intermediate : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-  class CSI_Ignore : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-  
-  class DCS_Entry : public State {
-    Action *enter( void ) const;
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-  class DCS_Param : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-  class DCS_Intermediate : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-  class DCS_Passthrough : public State {
-    Action *enter( void ) const;
-    Transition input_state_rule( wchar_t ch ) const;
-    Action *exit( void ) const;
-  };
-  class DCS_Ignore : public State {
-    Transition input_state_rule( wchar_t ch ) const;
-  };
-
-  class OSC_String : public State {
-    Action *enter( void ) const;
-    Transition input_state_rule( wchar_t ch ) const;
-    Action *exit( void ) const;
-  };
-  class SOS_PM_APC_String : public State {
-    Transition input_state_rule( wchar_t ch ) const;
+    ActionType enter( State state ) const { return entry_action[ state ]; }
+    ActionType exit( State state ) const { return exit_action[ state ]; }
   };
 }
 
@@ -20,10 +20,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <typeinfo>
 
 #include "terminal.h"
 #include "swrite.h"
+#include "mosh_wcwidth.h"
 
 using namespace Terminal;
 
@@ -38,16 +38,16 @@ std::string Emulator::read_octets_to_host( void )
   return ret;
 }
 
-void Emulator::execute( const Parser::Execute *act )
+void Emulator::execute( const Parser::HostAction *act )
 {
   dispatch.dispatch( CONTROL, act, &fb );
 }
 
-void Emulator::print( const Parser::Print *act )
+void Emulator::print( const Parser::HostAction *act )
 {
   assert( act->char_present );
 
-  int chwidth = act->ch == L'\0' ? -1 : wcwidth( act->ch );
+  int chwidth = act->ch == L'\0' ? -1 : mosh_wcwidth( act->ch );
 
   Cell *this_cell = fb.get_mutable_cell();
 
@@ -66,7 +66,7 @@ void Emulator::print( const Parser::Print *act )
     if ( fb.ds.auto_wrap_mode
 	 && (chwidth == 2)
 	 && (fb.ds.get_cursor_col() == fb.ds.get_width() - 1) ) {
-      fb.reset_cell( this_cell );
+      fb.reset_cell( fb.get_mutable_cell() );
       fb.get_mutable_row( -1 )->wrap = false;
       /* There doesn't seem to be a consistent way to get the
 	 downstream terminal emulator to set the wrap-around
@@ -85,8 +85,8 @@ void Emulator::print( const Parser::Print *act )
     this_cell = fb.get_mutable_cell();
 
     fb.reset_cell( this_cell );
-    this_cell->contents.push_back( act->ch );
-    this_cell->width = chwidth;
+    this_cell->append( act->ch );
+    this_cell->wide = (chwidth == 2);
     fb.apply_renditions_to_current_cell();
 
     if ( chwidth == 2 ) { /* erase overlapped cell */
@@ -105,17 +105,17 @@ void Emulator::print( const Parser::Print *act )
       break;
     }
 
-    if ( combining_cell->contents.size() == 0 ) {
+    if ( combining_cell->empty() ) {
       /* cell starts with combining character */
       assert( this_cell == combining_cell );
-      assert( combining_cell->width == 1 );
+      assert( !combining_cell->wide );
       combining_cell->fallback = true;
       fb.ds.move_col( 1, true, true );
     }
 
-    if ( combining_cell->contents.size() < 16 ) {
+    if ( combining_cell->char_count() < 16 ) {
       /* seems like a reasonable limit on combining characters */
-      combining_cell->contents.push_back( act->ch );
+      combining_cell->append( act->ch );
     }
     act->handled = true;
     break;
@@ -126,23 +126,110 @@ void Emulator::print( const Parser::Print *act )
   }
 }
 
-void Emulator::CSI_dispatch( const Parser::CSI_Dispatch *act )
+/* Print a run of characters. Characters that fit on the current row
+   without wrapping or inserting are written in one pass; the rest go
+   through print() one at a time. */
+void Emulator::print_run( const Parser::HostAction *begin, const Parser::HostAction *end )
+{
+  while ( begin != end ) {
+    int row = fb.ds.get_cursor_row(), col = fb.ds.get_cursor_col();
+    int width = fb.ds.get_width();
+
+    /* in origin mode, moving the cursor snaps it into the scrolling region */
+    bool outside_region = fb.ds.origin_mode
+      && ( (row < fb.ds.get_scrolling_region_top_row())
+	   || (row > fb.ds.get_scrolling_region_bottom_row()) );
+
+    if ( fb.ds.insert_mode || fb.ds.next_print_will_wrap || outside_region ) {
+      print( begin++ );
+      continue;
+    }
+
+    /* how many characters fit? */
+    const Parser::HostAction *run_end = begin;
+    int run_width = 0, last_width = 0;
+    while ( run_end != end ) {
+      wchar_t ch = run_end->ch;
+      int chwidth = ch == L'\0' ? -1 : mosh_wcwidth( ch );
+      if ( ((chwidth != 1) && (chwidth != 2))
+	   || (col + run_width + chwidth > width) ) {
+	break;
+      }
+      run_width += chwidth;
+      last_width = chwidth;
+      run_end++;
+    }
+
+    if ( run_end == begin ) {
+      print( begin++ );
+      continue;
+    }
+
+    Row *this_row = fb.get_mutable_row( -1, col, col + run_width );
+    Renditions renditions = fb.ds.get_renditions();
+    int background = fb.ds.get_background_rendition();
+
+    for ( const Parser::HostAction *act = begin; act != run_end; act++ ) {
+      Cell *cell = &this_row->cells[ col ];
+      cell->reset( background );
+      cell->append( act->ch );
+      cell->renditions = renditions;
+      if ( mosh_wcwidth( act->ch ) == 2 ) {
+	cell->wide = true;
+	this_row->cells[ col + 1 ].reset( background ); /* erase overlapped cell */
+	col += 2;
+      } else {
+	col++;
+      }
+      act->handled = true;
+    }
+
+    /* leave the cursor and combining-character position as
+       printing the characters one by one would have */
+    fb.ds.move_col( run_width - last_width, true, true );
+    fb.ds.move_col( last_width, true, true );
+
+    begin = run_end;
+  }
+}
+
+void Emulator::act( const Parser::HostActions &actions )
+{
+  Parser::HostActions::const_iterator i = actions.begin();
+
+  while ( i != actions.end() ) {
+    if ( i->type == Parser::PRINT ) {
+      /* hand consecutive printable characters over together */
+      Parser::HostActions::const_iterator run_end = i + 1;
+      while ( (run_end != actions.end()) && (run_end->type == Parser::PRINT) ) {
+	run_end++;
+      }
+      print_run( &*i, &*i + (run_end - i) );
+      i = run_end;
+    } else {
+      i->act_on_terminal( this );
+      i++;
+    }
+  }
+}
+
+void Emulator::CSI_dispatch( const Parser::HostAction *act )
 {
   dispatch.dispatch( CSI, act, &fb );
 }
 
-void Emulator::OSC_end( const Parser::OSC_End *act )
+void Emulator::OSC_end( const Parser::HostAction *act )
 {
   dispatch.OSC_dispatch( act, &fb );
 }
 
-void Emulator::Esc_dispatch( const Parser::Esc_Dispatch *act )
+void Emulator::Esc_dispatch( const Parser::HostAction *act )
 {
   /* handle 7-bit ESC-encoding of C1 control characters */
-  if ( (dispatch.get_dispatch_chars().size() == 0)
+  if ( (dispatch.get_intermediate_count() == 0)
        && (0x40 <= act->ch)
        && (act->ch <= 0x5F) ) {
-    Parser::Esc_Dispatch act2 = *act;
+    Parser::HostAction act2 = *act;
     act2.ch += 0x40;
     dispatch.dispatch( CONTROL, &act2, &fb );
   } else {
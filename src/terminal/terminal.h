@@ -32,31 +32,25 @@
 
 namespace Terminal {
   class Emulator {
-    friend void Parser::Print::act_on_terminal( Emulator * ) const;
-    friend void Parser::Execute::act_on_terminal( Emulator * ) const;
-    friend void Parser::Clear::act_on_terminal( Emulator * ) const;
-    friend void Parser::Param::act_on_terminal( Emulator * ) const;
-    friend void Parser::Collect::act_on_terminal( Emulator * ) const;
-    friend void Parser::CSI_Dispatch::act_on_terminal( Emulator * ) const;
-    friend void Parser::Esc_Dispatch::act_on_terminal( Emulator * ) const;
-    friend void Parser::OSC_Start::act_on_terminal( Emulator * ) const;
-    friend void Parser::OSC_Put::act_on_terminal( Emulator * ) const;
-    friend void Parser::OSC_End::act_on_terminal( Emulator * ) const;
+    friend void Parser::HostAction::act_on_terminal( Emulator * ) const;
 
     friend void Parser::UserByte::act_on_terminal( Emulator * ) const;
     friend void Parser::Resize::act_on_terminal( Emulator * ) const;
 
+    friend class Complete; /* applies screen diffs to the framebuffer */
+
   private:
     Framebuffer fb;
     Dispatcher dispatch;
     UserInput user;
 
     /* action methods */
-    void print( const Parser::Print *act );
-    void execute( const Parser::Execute *act );
-    void CSI_dispatch( const Parser::CSI_Dispatch *act );
-    void Esc_dispatch( const Parser::Esc_Dispatch *act );
-    void OSC_end( const Parser::OSC_End *act );
+    void print( const Parser::HostAction *act );
+    void print_run( const Parser::HostAction *begin, const Parser::HostAction *end );
+    void execute( const Parser::HostAction *act );
+    void CSI_dispatch( const Parser::HostAction *act );
+    void Esc_dispatch( const Parser::HostAction *act );
+    void OSC_end( const Parser::HostAction *act );
     void resize( size_t s_width, size_t s_height );
 
   public:
@@ -64,6 +58,8 @@ namespace Terminal {
 
     std::string read_octets_to_host( void );
 
+    void act( const Parser::HostActions &actions );
+
     static std::string open( void ); /* put user cursor keys in application mode */
     static std::string close( void ); /* restore user cursor keys */
 
@@ -18,9 +18,8 @@
 
 #include <stdio.h>
 #include <assert.h>
-#include <string.h>
-#include <errno.h>
 #include <stdlib.h>
+#include <algorithm>
 
 #include "terminaldispatcher.h"
 #include "parseraction.h"
@@ -29,92 +28,68 @@
 using namespace Terminal;
 
 Dispatcher::Dispatcher()
-  : params(), parsed_params(), parsed( false ), dispatch_chars(),
+  : params(), num_params( 1 ), params_overflowed( false ),
+    intermediate_chars( 0 ), intermediate_count( 0 ), final_char( 0 ),
     OSC_string(), terminal_to_host()
-{}
+{
+  params[ 0 ] = -1;
+}
 
-void Dispatcher::newparamchar( const Parser::Param *act )
+void Dispatcher::newparamchar( const Parser::HostAction *act )
 {
   assert( act->char_present );
   assert( (act->ch == ';') || ( (act->ch >= '0') && (act->ch <= '9') ) );
-  if ( params.length() < 100 ) {
-    /* enough for 16 five-char params plus 15 semicolons */
-    params.push_back( act->ch );
-    act->handled = true;
+  if ( params_overflowed ) {
+    return;
+  }
+
+  if ( act->ch == ';' ) {
+    if ( num_params == MAX_PARAMS ) {
+      params_overflowed = true;
+      return;
+    }
+    params[ num_params++ ] = -1;
+  } else {
+    int &param = params[ num_params - 1 ];
+    int digit = act->ch - '0';
+    if ( param < 0 ) {
+      param = digit;
+    } else {
+      param = std::min( param * 10 + digit, int( PARAM_LIMIT ) );
+    }
   }
-  parsed = false;
+  act->handled = true;
 }
 
-void Dispatcher::collect( const Parser::Collect *act )
+void Dispatcher::collect( const Parser::HostAction *act )
 {
   assert( act->char_present );
-  if ( ( dispatch_chars.length() < 8 ) /* never should need more than 2 */
+  if ( ( intermediate_count < 8 ) /* never should need more than 2 */
        && ( act->ch <= 255 ) ) {  /* ignore non-8-bit */    
-    dispatch_chars.push_back( act->ch );
+    if ( intermediate_count < MAX_INTERMEDIATES ) {
+      intermediate_chars = (intermediate_chars << 8) | act->ch;
+    }
+    intermediate_count++;
     act->handled = true;
   }
 }
 
-void Dispatcher::clear( const Parser::Clear *act )
+void Dispatcher::clear( const Parser::HostAction *act )
 {
-  params.clear();
-  dispatch_chars.clear();
-  parsed = false;
+  params[ 0 ] = -1;
+  num_params = 1;
+  params_overflowed = false;
+  intermediate_chars = 0;
+  intermediate_count = 0;
+  final_char = 0;
   act->handled = true;
 }
 
-void Dispatcher::parse_params( void )
-{
-  if ( parsed ) {
-    return;
-  }
-
-  parsed_params.clear();
-  const char *str = params.c_str();
-  const char *segment_begin = str;
-
-  while ( 1 ) {
-    const char *segment_end = strchr( segment_begin, ';' );
-    if ( segment_end == NULL ) {
-      break;
-    }
-
-    errno = 0;
-    char *endptr;
-    int val = strtol( segment_begin, &endptr, 10 );
-    if ( endptr == segment_begin ) {
-      val = -1;
-    }
-    if ( errno == 0 ) {
-      parsed_params.push_back( val );
-    }
-
-    segment_begin = segment_end + 1;
-  }
-
-  /* get last param */
-  errno = 0;
-  char *endptr;
-  int val = strtol( segment_begin, &endptr, 10 );
-  if ( endptr == segment_begin ) {
-    val = -1;
-  }
-  if ( errno == 0 ) {
-    parsed_params.push_back( val );
-  }
-
-  parsed = true;
-}
-
 int Dispatcher::getparam( size_t N, int defaultval )
 {
   int ret = defaultval;
-  if ( !parsed ) {
-    parse_params();
-  }
-
-  if ( parsed_params.size() > N ) {
-    ret = parsed_params[ N ];
+  if ( N < size_t( num_params ) ) {
+    ret = params[ N ];
   }
   if ( ret < 1 ) ret = defaultval;
 
@@ -123,18 +98,36 @@ int Dispatcher::getparam( size_t N, int defaultval )
 
 int Dispatcher::param_count( void )
 {
-  if ( !parsed ) {
-    parse_params();
-  }
-
-  return parsed_params.size();
+  return num_params;
 }
 
 std::string Dispatcher::str( void )
 {
+  char dispatch_chars[ MAX_INTERMEDIATES + 2 ];
+  int len = 0;
+  for ( int i = std::min( intermediate_count, MAX_INTERMEDIATES ) - 1; i >= 0; i-- ) {
+    dispatch_chars[ len++ ] = (intermediate_chars >> (8 * i)) & 0xff;
+  }
+  if ( final_char ) {
+    dispatch_chars[ len++ ] = final_char;
+  }
+  dispatch_chars[ len ] = 0;
+
+  std::string param_str;
+  for ( int i = 0; i < num_params; i++ ) {
+    if ( i ) {
+      param_str.push_back( ';' );
+    }
+    if ( params[ i ] >= 0 ) {
+      char num[ 16 ];
+      snprintf( num, 16, "%d", params[ i ] );
+      param_str.append( num );
+    }
+  }
+
   char assum[ 64 ];
   snprintf( assum, 64, "[dispatch=\"%s\" params=\"%s\"]",
-	    dispatch_chars.c_str(), params.c_str() );
+	    dispatch_chars, param_str.c_str() );
   return std::string( assum );
 }
 
@@ -145,19 +138,49 @@ DispatchRegistry & Terminal::get_global_dispatch_registry( void )
   return global_dispatch_registry;
 }
 
+void FunctionTable::insert( uint32_t key, const Function &f )
+{
+  assert( key != 0 );
+  int i = slot( key );
+  while ( keys[ i ] && ( keys[ i ] != key ) ) {
+    i = (i + 1) % SLOTS;
+  }
+  keys[ i ] = key;
+  functions[ i ] = f;
+}
+
+const Function *FunctionTable::find( uint32_t key ) const
+{
+  for ( int i = slot( key ); keys[ i ]; i = (i + 1) % SLOTS ) {
+    if ( keys[ i ] == key ) {
+      return &functions[ i ];
+    }
+  }
+  return NULL;
+}
+
 static void register_function( Function_Type type,
 			       std::string dispatch_chars,
 			       Function f )
 {
+  /* pack the same way Dispatcher::collect() does */
+  uint32_t key = 0;
+  assert( dispatch_chars.length() > 0 );
+  assert( dispatch_chars.length() <= 4 );
+  for ( size_t i = 0; i < dispatch_chars.length(); i++ ) {
+    key = (key << 8) | (unsigned char)dispatch_chars[ i ];
+  }
+
   switch ( type ) {
   case ESCAPE:
-    get_global_dispatch_registry().escape.insert( dispatch_map_t::value_type( dispatch_chars, f ) );
+    get_global_dispatch_registry().escape.insert( key, f );
     break;
   case CSI:
-    get_global_dispatch_registry().CSI.insert( dispatch_map_t::value_type( dispatch_chars, f ) );
+    get_global_dispatch_registry().CSI.insert( key, f );
     break;
   case CONTROL:
-    get_global_dispatch_registry().control.insert( dispatch_map_t::value_type( dispatch_chars, f ) );
+    assert( dispatch_chars.length() == 1 );
+    get_global_dispatch_registry().control[ key ] = f;
     break;
   }
 }
@@ -170,46 +193,44 @@ Function::Function( Function_Type type, std::string dispatch_chars,
   register_function( type, dispatch_chars, *this );
 }
 
-void Dispatcher::dispatch( Function_Type type, const Parser::Action *act, Framebuffer *fb )
+void Dispatcher::dispatch( Function_Type type, const Parser::HostAction *act, Framebuffer *fb )
 {
-  /* add final char to dispatch key */
-  if ( (type == ESCAPE) || (type == CSI) ) {
-    assert( act->char_present );
-    Parser::Collect act2;
-    act2.char_present = true;
-    act2.ch = act->ch;
-    collect( &act2 ); 
-  }
+  const DispatchRegistry &registry = get_global_dispatch_registry();
+  const Function *func = NULL;
 
-  dispatch_map_t *map = NULL;
   switch ( type ) {
-  case ESCAPE:  map = &get_global_dispatch_registry().escape;  break;
-  case CSI:     map = &get_global_dispatch_registry().CSI;     break;
-  case CONTROL: map = &get_global_dispatch_registry().control; break;
-  }
-
-  std::string key = dispatch_chars;
-  if ( type == CONTROL ) {
+  case ESCAPE:
+  case CSI:
+    assert( act->char_present );
+    final_char = act->ch;
+    /* a key with too many intermediates, or a non-8-bit final char, matches nothing */
+    if ( ( intermediate_count <= MAX_INTERMEDIATES ) && ( act->ch <= 255 ) ) {
+      uint32_t key = (intermediate_chars << 8) | act->ch;
+      func = (type == ESCAPE ? registry.escape : registry.CSI).find( key );
+    }
+    break;
+  case CONTROL:
     assert( act->ch <= 255 );
-    char ctrlstr[ 2 ] = { (char)act->ch, 0 };
-    key = std::string( ctrlstr, 1 );
+    if ( registry.control[ act->ch ].function ) {
+      func = &registry.control[ act->ch ];
+    }
+    break;
   }
 
-  dispatch_map_t::const_iterator i = map->find( key );
-  if ( i == map->end() ) {
+  if ( !func ) {
     /* unknown function */
     fb->ds.next_print_will_wrap = false;
     return;
   } else {
     act->handled = true;
-    if ( i->second.clears_wrap_state ) {
+    if ( func->clears_wrap_state ) {
       fb->ds.next_print_will_wrap = false;
     }
-    return i->second.function( fb, this );
+    return func->function( fb, this );
   }
 }
 
-void Dispatcher::OSC_put( const Parser::OSC_Put *act )
+void Dispatcher::OSC_put( const Parser::HostAction *act )
 {
   assert( act->char_present );
   if ( OSC_string.size() < 256 ) { /* should be a long enough window title */
@@ -218,7 +239,7 @@ void Dispatcher::OSC_put( const Parser::OSC_Put *act )
   }
 }
 
-void Dispatcher::OSC_start( const Parser::OSC_Start *act )
+void Dispatcher::OSC_start( const Parser::HostAction *act )
 {
   OSC_string.clear();
   act->handled = true;
@@ -226,6 +247,8 @@ void Dispatcher::OSC_start( const Parser::OSC_Start *act )
 
 bool Dispatcher::operator==( const Dispatcher &x ) const
 {
-  return ( params == x.params ) && ( parsed_params == x.parsed_params ) && ( parsed == x.parsed )
-    && ( dispatch_chars == x.dispatch_chars ) && ( OSC_string == x.OSC_string ) && ( terminal_to_host == x.terminal_to_host );
+  return ( num_params == x.num_params ) && std::equal( params, params + num_params, x.params )
+    && ( params_overflowed == x.params_overflowed )
+    && ( intermediate_chars == x.intermediate_chars ) && ( intermediate_count == x.intermediate_count )
+    && ( final_char == x.final_char ) && ( OSC_string == x.OSC_string ) && ( terminal_to_host == x.terminal_to_host );
 }
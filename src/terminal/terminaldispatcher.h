@@ -21,19 +21,10 @@
 
 #include <vector>
 #include <string>
-#include <map>
+#include <stdint.h>
 
 namespace Parser {
-  class Action;
-  class Param;
-  class Collect;
-  class Clear;
-  class Esc_Dispatch;
-  class CSI_Dispatch;
-  class Execute;
-  class OSC_Start;
-  class OSC_Put;
-  class OSC_End;
+  class HostAction;
 }
 
 namespace Terminal {
@@ -52,13 +43,30 @@ namespace Terminal {
     bool clears_wrap_state;
   };
 
-  typedef std::map<std::string, Function> dispatch_map_t;
+  /* Escape and CSI functions, keyed by their intermediate characters
+     and final character packed one per byte. Open addressing with
+     room to spare keeps lookups to a probe or two. */
+  class FunctionTable {
+  private:
+    static const int SLOTS = 256;
+
+    uint32_t keys[ SLOTS ]; /* zero if the slot is empty */
+    Function functions[ SLOTS ];
+
+    static int slot( uint32_t key ) { return (key * 2654435761U) >> 24; }
+
+  public:
+    FunctionTable() : keys(), functions() {}
+
+    void insert( uint32_t key, const Function &f );
+    const Function *find( uint32_t key ) const;
+  };
 
   class DispatchRegistry {
   public:
-    dispatch_map_t escape;
-    dispatch_map_t CSI;
-    dispatch_map_t control;
+    FunctionTable escape;
+    FunctionTable CSI;
+    Function control[ 256 ]; /* indexed by the control character */
 
     DispatchRegistry() : escape(), CSI(), control() {}
   };
@@ -67,15 +75,22 @@ namespace Terminal {
 
   class Dispatcher {
   private:
-    std::string params;
-    std::vector<int> parsed_params;
-    bool parsed;
+    /* numeric parameters, parsed as their characters arrive. An
+       empty parameter is -1 and large values are clamped. */
+    static const int MAX_PARAMS = 32;
+    static const int PARAM_LIMIT = 65535;
+    int params[ MAX_PARAMS ];
+    int num_params;
+    bool params_overflowed; /* any further parameters are dropped */
+
+    /* intermediate characters of the sequence, one per byte */
+    static const int MAX_INTERMEDIATES = 3;
+    uint32_t intermediate_chars;
+    int intermediate_count;
+    wchar_t final_char;
 
-    std::string dispatch_chars;
     std::vector<wchar_t> OSC_string; /* only used to set the window title */
 
-    void parse_params( void );
-
   public:
     std::string terminal_to_host; /* this is the reply string */
 
@@ -83,19 +98,20 @@ namespace Terminal {
     int getparam( size_t N, int defaultval );
     int param_count( void );
 
-    void newparamchar( const Parser::Param *act );
-    void collect( const Parser::Collect *act );
-    void clear( const Parser::Clear *act );
+    void newparamchar( const Parser::HostAction *act );
+    void collect( const Parser::HostAction *act );
+    void clear( const Parser::HostAction *act );
     
     std::string str( void );
 
-    void dispatch( Function_Type type, const Parser::Action *act, Framebuffer *fb );
-    std::string get_dispatch_chars( void ) { return dispatch_chars; }
+    void dispatch( Function_Type type, const Parser::HostAction *act, Framebuffer *fb );
+    int get_intermediate_count( void ) const { return intermediate_count; }
+    wchar_t get_final_char( void ) const { return final_char; }
     std::vector<wchar_t> get_OSC_string( void ) { return OSC_string; }
 
-    void OSC_put( const Parser::OSC_Put *act );
-    void OSC_start( const Parser::OSC_Start *act );
-    void OSC_dispatch( const Parser::OSC_End *act, Framebuffer *fb );
+    void OSC_put( const Parser::HostAction *act );
+    void OSC_start( const Parser::HostAction *act );
+    void OSC_dispatch( const Parser::HostAction *act, Framebuffer *fb );
 
     bool operator==( const Dispatcher &x ) const;
   };
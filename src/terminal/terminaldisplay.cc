@@ -18,7 +18,9 @@
 
 #include <boost/typeof/typeof.hpp>
 #include <assert.h>
-#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
 
 #include "terminaldisplay.h"
 
@@ -28,9 +30,15 @@ using namespace Terminal;
 
 std::string Display::new_frame( bool initialized, const Framebuffer &last, const Framebuffer &f )
 {
-  FrameState frame( last );
+  std::string output;
+  new_frame( initialized, last, f, output );
+  return output;
+}
 
-  char tmp[ 64 ];
+void Display::new_frame( bool initialized, const Framebuffer &last, const Framebuffer &f,
+			 std::string &output )
+{
+  FrameState frame( last, output );
 
   /* has bell been rung? */
   if ( f.get_bell_count() != frame.last_frame.get_bell_count() ) {
@@ -46,8 +54,7 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
     for ( BOOST_AUTO( i, window_title.begin() );
 	  i != window_title.end();
 	  i++ ) {
-      snprintf( tmp, 64, "%lc", *i );
-      frame.append( tmp );
+      frame.append_utf8( *i );
     }
     frame.append( "\033\\" );
   }
@@ -56,89 +63,64 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
   if ( (!initialized)
        || (f.ds.reverse_video != frame.last_frame.ds.reverse_video) ) {
     /* set reverse video */
-    snprintf( tmp, 64, "\033[?5%c", (f.ds.reverse_video ? 'h' : 'l') );
-    frame.append( tmp );
+    frame.append( f.ds.reverse_video ? "\033[?5h" : "\033[?5l" );
   }
 
   /* has size changed? */
   if ( (!initialized)
        || (f.ds.get_width() != frame.last_frame.ds.get_width())
        || (f.ds.get_height() != frame.last_frame.ds.get_height()) ) {
+    /* a full repaint is about a byte per cell, plus a move and
+       a rendition change per row */
+    frame.str.reserve( f.ds.get_width() * f.ds.get_height() + 32 * f.ds.get_height() );
+
     /* clear screen */
     frame.append( "\033[0m\033[H\033[2J" );
     initialized = false;
     frame.cursor_x = frame.cursor_y = 0;
-    frame.current_rendition_string = "\033[0m";
+    frame.current_rendition = Renditions( 0 );
   } else {
     frame.cursor_x = frame.last_frame.ds.get_cursor_col();
     frame.cursor_y = frame.last_frame.ds.get_cursor_row();
-    frame.current_rendition_string = frame.last_frame.ds.get_renditions().sgr();
+    frame.current_rendition = frame.last_frame.ds.get_renditions();
   }
 
-  /* shortcut -- has display moved up by a certain number of lines? */
-  frame.y = 0;
-
+  /* shortcut -- have parts of the display moved up or down? */
   if ( initialized ) {
-    int lines_scrolled = 0;
-    int scroll_height = 0;
-
-    for ( int row = 0; row < f.ds.get_height(); row++ ) {
-      if ( *(f.get_row( 0 )) == *(frame.last_frame.get_row( row )) ) {
-	/* found a scroll */
-	lines_scrolled = row;
-	scroll_height = 1;
-
-	/* how big is the region that was scrolled? */
-	for ( int region_height = 1;
-	      lines_scrolled + region_height < f.ds.get_height();
-	      region_height++ ) {
-	  if ( *(f.get_row( region_height ))
-	       == *(frame.last_frame.get_row( lines_scrolled + region_height )) ) {
-	    scroll_height = region_height + 1;
-	  } else {
-	    break;
-	  }
-	}
+    put_scrolls( frame, f );
+  }
 
-	break;
+  /* iterate for every cell */
+  for ( frame.y = 0; frame.y < f.ds.get_height(); frame.y++ ) {
+    int dirty_start = 0, dirty_end = f.ds.get_width();
+
+    if ( initialized ) {
+      const Row *new_row = f.get_row( frame.y );
+      const Row *old_row = frame.get_last_row( frame.y );
+
+      /* only visit the columns that changed since the old frame */
+      if ( (new_row->wrap != old_row->wrap)
+	   || !new_row->dirty_since( old_row->gen, dirty_start, dirty_end ) ) {
+	dirty_start = 0;
+	dirty_end = f.ds.get_width();
       }
-    }
-
-    if ( scroll_height ) {
-      frame.y = scroll_height;
-
-      if ( lines_scrolled ) {
-	if ( frame.cursor_y != f.ds.get_height() - 1 ) {
-	  frame.append_silent_move( f.ds.get_height() - 1, 0 );
-	}
 
-	if ( frame.current_rendition_string != "\033[0m" ) {
-	  frame.append( "\033[0m" );
-	  frame.current_rendition_string = "\033[0m";
-	}
-
-	for ( int i = 0; i < lines_scrolled; i++ ) {
-	  frame.append( "\n" );
-	}
-
-	for ( int i = 0; i < f.ds.get_height(); i++ ) {
-	  if ( i + lines_scrolled < f.ds.get_height() ) {
-	    *(frame.last_frame.get_mutable_row( i )) = *(frame.last_frame.get_row( i + lines_scrolled ));
-	  } else {
-	    frame.last_frame.get_mutable_row( i )->reset( 0 );
-	  }
-	}
+      if ( dirty_start == dirty_end ) {
+	continue; /* row is unchanged */
       }
     }
-  }
 
-  /* iterate for every cell */
-  for ( ; frame.y < f.ds.get_height(); frame.y++ ) {
+    /* skip the clean prefix the same way put_cell() would */
+    frame.x = 0;
+    while ( frame.x < dirty_start ) {
+      frame.x += f.get_cell( frame.y, frame.x )->get_width();
+    }
+
     int last_x = 0;
-    for ( frame.x = 0;
-	  frame.x < f.ds.get_width(); /* let put_cell() handle advance */ ) {
+    for ( ; frame.x < dirty_end; /* let put_cell() handle advance */ ) {
       last_x = frame.x;
-      put_cell( initialized, frame, f );
+      put_cell( frame, f,
+		initialized ? &frame.get_last_row( frame.y )->cells[ frame.x ] : NULL );
 
       /* To hint that a word-select should group the end of one line
 	 with the beginning of the next, we let the real cursor
@@ -147,44 +129,46 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
       if ( (frame.cursor_x >= f.ds.get_width())
 	   && (frame.y < f.ds.get_height() - 1)
 	   && f.get_row( frame.y )->wrap
-	   && (!initialized || !frame.last_frame.get_row( frame.y )->wrap) ) {
+	   && (!initialized || !frame.get_last_row( frame.y )->wrap) ) {
 	/* next write will wrap */
 	frame.cursor_x = 0;
 	frame.cursor_y++;
+	frame.pending_wrap = true;
       }
     }
 
     /* Turn off wrap */
     if ( (frame.y < f.ds.get_height() - 1)
 	 && (!f.get_row( frame.y )->wrap)
-	 && (!initialized || frame.last_frame.get_row( frame.y )->wrap) ) {
+	 && (!initialized || frame.get_last_row( frame.y )->wrap) ) {
       frame.x = last_x;
-      if ( initialized ) {
-	frame.last_frame.reset_cell( frame.last_frame.get_mutable_cell( frame.y, frame.x ) );
-      }
 
-      snprintf( tmp, 64, "\033[%d;%dH\033[K", frame.y + 1, frame.x + 1 );
-      frame.append( tmp );
+      /* erase in the default rendition */
+      frame.update_rendition( Renditions( 0 ) );
+      frame.append_move( frame.y, frame.x );
+      frame.append( "\033[K" );
       frame.cursor_x = frame.x;
+      frame.cursor_y = frame.y;
 
-      put_cell( initialized, frame, f );
+      /* the erase has just blanked this cell */
+      const Cell blank( 0 );
+      put_cell( frame, f, initialized ? &blank : NULL );
     }
   }
 
   /* has cursor location changed? */
   if ( (!initialized)
+       || frame.pending_wrap
        || (f.ds.get_cursor_row() != frame.cursor_y)
        || (f.ds.get_cursor_col() != frame.cursor_x) ) {
-    snprintf( tmp, 64, "\033[%d;%dH", f.ds.get_cursor_row() + 1,
-	      f.ds.get_cursor_col() + 1 );
-    frame.append( tmp );
+    frame.append_move( f.ds.get_cursor_row(), f.ds.get_cursor_col() );
     frame.cursor_x = f.ds.get_cursor_col();
     frame.cursor_y = f.ds.get_cursor_row();
   }
 
   /* has cursor visibility changed? */
   if ( (!initialized)
-       || (f.ds.cursor_visible != frame.last_frame.ds.cursor_visible) ) {
+       || (f.ds.cursor_visible != frame.cursor_visible) ) {
     if ( f.ds.cursor_visible ) {
       frame.append( "\033[?25h" );
     } else {
@@ -193,87 +177,312 @@ std::string Display::new_frame( bool initialized, const Framebuffer &last, const
   }
 
   /* have renditions changed? */
-  if ( (!initialized)
-       || (f.ds.get_renditions().sgr() != frame.current_rendition_string) ) {
-    frame.appendstring( f.ds.get_renditions().sgr() );
-    frame.current_rendition_string = f.ds.get_renditions().sgr();
+  frame.update_rendition( f.ds.get_renditions() );
+}
+
+/* Find rows of the previous frame that have moved up or down within
+   the screen, and move them there with region scrolls rather than
+   redraw them. Rows are matched by their hashes. A false match costs
+   only bytes, since every row is still compared cell by cell against
+   what the screen shows afterwards. */
+void Display::put_scrolls( FrameState &frame, const Framebuffer &f )
+{
+  const int height = f.ds.get_height();
+
+  /* nothing to do if no row has changed */
+  int first_changed = 0;
+  while ( (first_changed < height)
+	  && (*f.get_row( first_changed ) == *frame.last_frame.get_row( first_changed )) ) {
+    first_changed++;
+  }
+  if ( first_changed == height ) {
+    return;
+  }
+
+  /* A scroll can only pay for itself by fixing more than one row,
+     or by bringing the one changed row from elsewhere on the screen. */
+  int next_changed = first_changed + 1;
+  while ( (next_changed < height)
+	  && (*f.get_row( next_changed ) == *frame.last_frame.get_row( next_changed )) ) {
+    next_changed++;
+  }
+  if ( next_changed == height ) {
+    const uint64_t changed_hash = f.get_row( first_changed )->hash();
+    int i = 0;
+    while ( (i < height)
+	    && ((i == first_changed) || (frame.last_frame.get_row( i )->hash() != changed_hash)) ) {
+      i++;
+    }
+    if ( i == height ) {
+      return;
+    }
+  }
+
+  const uint64_t blank_hash = frame.get_blank_row()->hash();
+  std::vector<uint64_t> new_hash( height ), screen_hash( height );
+  std::vector<const Row *> screen( height );
+  for ( int i = 0; i < height; i++ ) {
+    new_hash[ i ] = f.get_row( i )->hash();
+    screen[ i ] = frame.last_frame.get_row( i );
+    screen_hash[ i ] = screen[ i ]->hash();
+  }
+
+  /* running counts of new rows that are blank, and that the screen already shows */
+  std::vector<int> blank_count( height + 1 ), match_count( height + 1 );
+  for ( int i = 0; i < height; i++ ) {
+    blank_count[ i + 1 ] = blank_count[ i ] + (new_hash[ i ] == blank_hash);
   }
 
-  return frame.str;
+  for ( int pass = 0; pass < MAX_SCROLLS; pass++ ) {
+    for ( int i = 0; i < height; i++ ) {
+      match_count[ i + 1 ] = match_count[ i ] + (new_hash[ i ] == screen_hash[ i ]);
+    }
+
+    /* Each run of new rows [start, start + len) that the screen shows
+       at an offset of "shift" can be brought into place by scrolling
+       the region that spans both positions. The rest of the region
+       is then blank. Pick the scroll that leaves the most rows right. */
+    int best_gain = 0, best_top = 0, best_bottom = 0, best_shift = 0;
+    for ( int shift = 1 - height; shift < height; shift++ ) {
+      if ( shift == 0 ) {
+	continue;
+      }
+
+      int first = std::max( 0, -shift ), last = std::min( height, height - shift );
+      int start = first, len = 0, content = 0;
+      for ( int i = first; i <= last; i++ ) {
+	if ( (i < last) && (new_hash[ i ] == screen_hash[ i + shift ]) ) {
+	  if ( len++ == 0 ) {
+	    start = i;
+	  }
+	  content += (new_hash[ i ] != blank_hash);
+	  continue;
+	}
+
+	if ( content ) {
+	  int top, bottom, blank_start, blank_end;
+	  if ( shift > 0 ) {
+	    top = start;
+	    bottom = start + len - 1 + shift;
+	    blank_start = start + len;
+	    blank_end = bottom + 1;
+	  } else {
+	    top = start + shift;
+	    bottom = start + len - 1;
+	    blank_start = top;
+	    blank_end = start;
+	  }
+
+	  int gain = len + (blank_count[ blank_end ] - blank_count[ blank_start ])
+	    - (match_count[ bottom + 1 ] - match_count[ top ]);
+	  if ( gain > best_gain ) {
+	    best_gain = gain;
+	    best_top = top;
+	    best_bottom = bottom;
+	    best_shift = shift;
+	  }
+	}
+	len = content = 0;
+      }
+    }
+
+    if ( best_gain == 0 ) {
+      break;
+    }
+
+    put_scroll( frame, best_top, best_bottom, best_shift, height );
+
+    /* move our picture of the screen along with it */
+    if ( best_shift > 0 ) {
+      for ( int i = best_top; i <= best_bottom; i++ ) {
+	bool moved = i + best_shift <= best_bottom;
+	screen[ i ] = moved ? screen[ i + best_shift ] : frame.get_blank_row();
+	screen_hash[ i ] = moved ? screen_hash[ i + best_shift ] : blank_hash;
+      }
+    } else {
+      for ( int i = best_bottom; i >= best_top; i-- ) {
+	bool moved = i + best_shift >= best_top;
+	screen[ i ] = moved ? screen[ i + best_shift ] : frame.get_blank_row();
+	screen_hash[ i ] = moved ? screen_hash[ i + best_shift ] : blank_hash;
+      }
+    }
+
+    frame.last_rows = screen;
+  }
 }
 
-void Display::put_cell( bool initialized, FrameState &frame, const Framebuffer &f )
+/* scroll rows top..bottom up by "lines" (down if negative) */
+void Display::put_scroll( FrameState &frame, int top, int bottom, int lines, int height )
 {
-  char tmp[ 64 ];
+  /* new lines take the current background color */
+  frame.update_rendition( Renditions( 0 ) );
 
-  const Cell *cell = f.get_cell( frame.y, frame.x );
+  if ( (top == 0) && (bottom == height - 1) && (lines > 0) ) {
+    /* whole screen moved up -- newlines at the bottom */
+    if ( frame.cursor_y != height - 1 ) {
+      frame.append_silent_move( height - 1, 0 );
+    }
 
-  if ( initialized
-       && ( *cell == *(frame.last_frame.get_cell( frame.y, frame.x )) ) ) {
-    frame.x += cell->width;
+    for ( int i = 0; i < lines; i++ ) {
+      frame.append( "\n" );
+    }
     return;
   }
 
-  if ( (frame.x != frame.cursor_x) || (frame.y != frame.cursor_y) ) {
-    frame.append_silent_move( frame.y, frame.x );
+  /* otherwise delete or insert lines at the top of the region,
+     first limiting the scrolling region if it ends above the bottom */
+  bool limit_region = ( bottom != height - 1 );
+  if ( limit_region ) {
+    frame.hide_cursor();
+    frame.append( "\033[" );
+    frame.append_number( top + 1 );
+    frame.append( ';' );
+    frame.append_number( bottom + 1 );
+    frame.append( 'r' );
   }
 
-  std::string rendition_str = cell->renditions.sgr();
+  frame.append_silent_move( top, 0 );
+  frame.append( "\033[" );
+  frame.append_number( abs( lines ) );
+  frame.append( lines > 0 ? 'M' : 'L' );
+
+  if ( limit_region ) {
+    /* restoring the scrolling region homes the cursor */
+    frame.append( "\033[r" );
+    frame.cursor_x = frame.cursor_y = 0;
+  }
+}
+
+void Display::put_cell( FrameState &frame, const Framebuffer &f, const Cell *last_cell )
+{
+  const Cell *cell = f.get_cell( frame.y, frame.x );
+
+  if ( last_cell && ( *cell == *last_cell ) ) {
+    frame.x += cell->get_width();
+    return;
+  }
 
-  if ( frame.current_rendition_string != rendition_str ) {
-    /* print renditions */
-    frame.appendstring( rendition_str );
-    frame.current_rendition_string = rendition_str;
+  /* only a printed character takes the terminal to a pending wrap's
+     new row; an erase would still act on the old one */
+  if ( (frame.x != frame.cursor_x) || (frame.y != frame.cursor_y)
+       || (frame.pending_wrap && cell->empty()) ) {
+    frame.append_silent_move( frame.y, frame.x );
   }
 
-  if ( cell->contents.empty() ) {
+  frame.update_rendition( cell->renditions );
+
+  if ( cell->empty() ) {
     /* see how far we can stretch a clear */
     int clear_count = 0;
     for ( int col = frame.x; col < f.ds.get_width(); col++ ) {
       const Cell *other_cell = f.get_cell( frame.y, col );
       if ( (cell->renditions == other_cell->renditions)
-	   && (other_cell->contents.empty()) ) {
+	   && (other_cell->empty()) ) {
 	clear_count++;
       } else {
 	break;
       }
     }
-    snprintf( tmp, 64, "\033[%dX", clear_count );
-    frame.append( tmp );
+    frame.append( "\033[" );
+    frame.append_number( clear_count );
+    frame.append( 'X' );
 
     frame.x += clear_count;
     return;
   }
 
   /* cells that begin with combining character get combiner attached to no-break space */
-  if ( cell->fallback ) {
-    snprintf( tmp, 64, "%lc", L'\xA0' );
-    frame.append( tmp );
+  cell->print_grapheme( frame.str );
+  frame.pending_wrap = false;
+
+  frame.x += cell->get_width();
+  frame.cursor_x += cell->get_width();
+}
+
+const Row *FrameState::get_blank_row( void ) const
+{
+  /* kept from frame to frame, so that it is built and hashed
+     only when the width changes */
+  static boost::shared_ptr<Row> blank_row;
+
+  size_t width = last_frame.ds.get_width();
+  if ( !blank_row || (blank_row->cells.size() != width) ) {
+    blank_row.reset( new Row( width, 0 ) );
   }
+  return blank_row.get();
+}
 
-  for ( std::vector<wchar_t>::const_iterator i = cell->contents.begin();
-	i != cell->contents.end();
-	i++ ) {
-    snprintf( tmp, 64, "%lc", *i );
-    frame.append( tmp );
+void FrameState::update_rendition( const Renditions &r )
+{
+  if ( !(current_rendition == r) ) {
+    r.sgr_change( current_rendition, str );
+    current_rendition = r;
   }
+}
 
-  frame.x += cell->width;
-  frame.cursor_x += cell->width;
+void FrameState::append_number( int n )
+{
+  assert( n >= 0 );
+
+  char digits[ 16 ];
+  int len = 0;
+  do {
+    digits[ len++ ] = '0' + n % 10;
+    n /= 10;
+  } while ( n );
+
+  while ( len ) {
+    str.push_back( digits[ --len ] );
+  }
 }
 
-void FrameState::append_silent_move( int y, int x )
+void FrameState::append_utf8( wchar_t ch )
 {
-  char tmp[ 64 ];
+  if ( (ch < 0) || (ch > 0x10FFFF) || ((ch >= 0xD800) && (ch <= 0xDFFF)) ) {
+    ch = 0xFFFD;
+  }
 
-  /* turn off cursor if necessary before moving cursor */
-  if ( last_frame.ds.cursor_visible ) {
+  if ( ch < 0x80 ) {
+    str.push_back( ch );
+  } else if ( ch < 0x800 ) {
+    str.push_back( 0xC0 | (ch >> 6) );
+    str.push_back( 0x80 | (ch & 0x3F) );
+  } else if ( ch < 0x10000 ) {
+    str.push_back( 0xE0 | (ch >> 12) );
+    str.push_back( 0x80 | ((ch >> 6) & 0x3F) );
+    str.push_back( 0x80 | (ch & 0x3F) );
+  } else {
+    str.push_back( 0xF0 | (ch >> 18) );
+    str.push_back( 0x80 | ((ch >> 12) & 0x3F) );
+    str.push_back( 0x80 | ((ch >> 6) & 0x3F) );
+    str.push_back( 0x80 | (ch & 0x3F) );
+  }
+}
+
+void FrameState::append_move( int y, int x )
+{
+  pending_wrap = false;
+  append( "\033[" );
+  append_number( y + 1 );
+  append( ';' );
+  append_number( x + 1 );
+  append( 'H' );
+}
+
+void FrameState::hide_cursor( void )
+{
+  if ( cursor_visible ) {
     append( "\033[?25l" );
-    last_frame.ds.cursor_visible = false;
+    cursor_visible = false;
   }
+}
+
+void FrameState::append_silent_move( int y, int x )
+{
+  /* turn off cursor if necessary before moving cursor */
+  hide_cursor();
 
-  snprintf( tmp, 64, "\033[%d;%dH", y + 1, x + 1 );
-  append( tmp );
+  append_move( y, x );
   cursor_x = x;
   cursor_y = y;
 }
@@ -26,33 +26,71 @@ namespace Terminal {
   class FrameState {
   public:
     int x, y;
-    std::string str;
+    std::string &str; /* output, owned by the caller so it can be reused */
 
     int cursor_x, cursor_y;
-    std::string current_rendition_string;
+    Renditions current_rendition; /* what the terminal is set to */
+    bool cursor_visible;
 
-    Framebuffer last_frame;
+    /* The cursor was moved to the start of the next row by filling a
+       wrapping row, but the terminal only goes there on the next
+       printed character. Until then, it is still on the last column. */
+    bool pending_wrap;
 
-    FrameState( const Framebuffer &s_last )
+    /* The previous frame is read in place, never copied. Once parts
+       of the display have been scrolled, last_rows holds the row the
+       screen shows on each line (blank_row where one was scrolled in).
+       While it is empty, the screen still shows last_frame as is. */
+    const Framebuffer &last_frame;
+    std::vector<const Row *> last_rows;
+
+    FrameState( const Framebuffer &s_last, std::string &s_str )
       : x(0), y(0),
-	str(), cursor_x(0), cursor_y(0), current_rendition_string(),
-	last_frame( s_last )
+	str( s_str ), cursor_x(0), cursor_y(0), current_rendition( 0 ),
+	cursor_visible( s_last.ds.cursor_visible ), pending_wrap( false ),
+	last_frame( s_last ), last_rows()
     {
+      str.clear();
       str.reserve( 1024 );
     }
 
+    /* These format escape sequences by hand, without snprintf()
+       or the locale. */
     void append( const char * s ) { str.append( s ); }
-    void appendstring( const std::string s ) { str.append( s ); }
+    void append( char c ) { str.push_back( c ); }
+    void appendstring( const std::string &s ) { str.append( s ); }
+    void append_number( int n );
+    void append_utf8( wchar_t ch );
+    void append_move( int y, int x );
+    void update_rendition( const Renditions &r );
 
+    void hide_cursor( void );
     void append_silent_move( int y, int x );
+
+    /* row of the previous frame as currently shown on the screen */
+    const Row *get_last_row( int row ) const
+    {
+      return last_rows.empty() ? last_frame.get_row( row ) : last_rows[ row ];
+    }
+
+    /* what a line scrolled onto the screen looks like */
+    const Row *get_blank_row( void ) const;
   };
 
   class Display {
   private:
-    static void put_cell( bool initialized, FrameState &frame, const Framebuffer &f );
+    static const int MAX_SCROLLS = 8; /* per frame */
+
+    /* last_cell is what the screen shows there, or NULL if unknown */
+    static void put_cell( FrameState &frame, const Framebuffer &f, const Cell *last_cell );
+
+    static void put_scrolls( FrameState &frame, const Framebuffer &f );
+    static void put_scroll( FrameState &frame, int top, int bottom, int lines, int height );
 
   public:
     static std::string new_frame( bool initialized, const Framebuffer &last, const Framebuffer &f );
+    static void new_frame( bool initialized, const Framebuffer &last, const Framebuffer &f,
+			   std::string &output );
   };
 }
 
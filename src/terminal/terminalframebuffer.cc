@@ -17,8 +17,10 @@
 */
 
 #include <boost/typeof/typeof.hpp>
+#include <algorithm>
 #include <assert.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "terminalframebuffer.h"
 
@@ -27,9 +29,45 @@ using namespace Terminal;
 void Cell::reset( int background_color )
 {
   contents.clear();
-  fallback = false;
-  width = 1;
   renditions = Renditions( background_color );
+  wide = false;
+  fallback = false;
+}
+
+void Cell::append( wchar_t c )
+{
+  /* encode as UTF-8 */
+  uint32_t u = c;
+
+  if ( u < 0x80 ) {
+    contents.push_back( u );
+  } else if ( u < 0x800 ) {
+    contents.push_back( 0xC0 | (u >> 6) );
+    contents.push_back( 0x80 | (u & 0x3F) );
+  } else if ( u < 0x10000 ) {
+    contents.push_back( 0xE0 | (u >> 12) );
+    contents.push_back( 0x80 | ((u >> 6) & 0x3F) );
+    contents.push_back( 0x80 | (u & 0x3F) );
+  } else {
+    contents.push_back( 0xF0 | (u >> 18) );
+    contents.push_back( 0x80 | ((u >> 12) & 0x3F) );
+    contents.push_back( 0x80 | ((u >> 6) & 0x3F) );
+    contents.push_back( 0x80 | (u & 0x3F) );
+  }
+}
+
+size_t Cell::char_count( void ) const
+{
+  /* count the bytes that are not UTF-8 continuation bytes */
+  size_t count = 0;
+  for ( std::string::const_iterator i = contents.begin();
+	i != contents.end();
+	i++ ) {
+    if ( (*i & 0xC0) != 0x80 ) {
+      count++;
+    }
+  }
+  return count;
 }
 
 DrawState::DrawState( int s_width, int s_height )
@@ -48,26 +86,69 @@ DrawState::DrawState( int s_width, int s_height )
 }
 
 Framebuffer::Framebuffer( int s_width, int s_height )
-  : rows( s_height, Row( s_width, 0 ) ), window_title(), bell_count( 0 ), ds( s_width, s_height )
+  : rows(), row_origin( 0 ), window_title(), bell_count( 0 ), ds( s_width, s_height )
 {
   assert( s_height > 0 );
   assert( s_width > 0 );
+
+  /* all rows start out sharing one blank row */
+  rows = rows_type( s_height, newrow() );
 }
 
 void Framebuffer::scroll( int N )
 {
-  if ( N >= 0 ) {
-    for ( int i = 0; i < N; i++ ) {
-      delete_line( ds.get_scrolling_region_top_row() );
-      ds.move_row( -1, true );
+  if ( N == 0 ) {
+    return;
+  }
+
+  shift_rows( ds.get_scrolling_region_top_row(), ds.get_scrolling_region_bottom_row(), N );
+  ds.move_row( -N, true );
+}
+
+/* replace a row that has left the screen with a blank one */
+void Framebuffer::blank_row( row_pointer &r )
+{
+  if ( r.unique() && ((int)r->cells.size() == ds.get_width()) ) {
+    r->recycle( ds.get_background_rendition() );
+  } else {
+    r = newrow();
+  }
+}
+
+/* move rows top..bottom up by N (down if N is negative),
+   filling the vacated rows with blank rows */
+void Framebuffer::shift_rows( int top, int bottom, int N )
+{
+  int height = ds.get_height();
+  int count = bottom - top + 1;
+  if ( count <= 0 ) {
+    return;
+  }
+
+  if ( N > count ) N = count;
+  if ( N < -count ) N = -count;
+
+  if ( (top == 0) && (bottom == height - 1) ) {
+    /* whole screen: rotate the circular buffer */
+    row_origin = (row_origin + N + height) % height;
+  } else if ( N > 0 ) {
+    for ( int i = top; i + N <= bottom; i++ ) {
+      std::swap( row_slot( i ), row_slot( i + N ) );
     }
   } else {
-    N = -N;
+    for ( int i = bottom; i + N >= top; i-- ) {
+      std::swap( row_slot( i ), row_slot( i + N ) );
+    }
+  }
 
-    for ( int i = 0; i < N; i++ ) {
-      rows.insert( rows.begin() + ds.get_scrolling_region_top_row(), newrow() );
-      rows.erase( rows.begin() + ds.get_scrolling_region_bottom_row() + 1 );
-      ds.move_row( 1, true );
+  /* the rows that were shifted out are now in the vacated slots */
+  if ( N > 0 ) {
+    for ( int i = bottom - N + 1; i <= bottom; i++ ) {
+      blank_row( row_slot( i ) );
+    }
+  } else {
+    for ( int i = top; i < top - N; i++ ) {
+      blank_row( row_slot( i ) );
     }
   }
 }
@@ -149,7 +230,7 @@ Cell *Framebuffer::get_combining_cell( void )
     return NULL;
   } /* can happen if a resize came in between */
 
-  return &rows[ ds.get_combining_char_row() ].cells[ ds.get_combining_char_col() ];
+  return get_mutable_cell( ds.get_combining_char_row(), ds.get_combining_char_col() );
 }
 
 void DrawState::set_tab( void )
@@ -257,8 +338,7 @@ void Framebuffer::insert_line( int before_row )
     return;
   }
 
-  rows.insert( rows.begin() + before_row, newrow() );
-  rows.erase( rows.begin() + ds.get_scrolling_region_bottom_row() + 1 );
+  shift_rows( before_row, ds.get_scrolling_region_bottom_row(), -1 );
 }
 
 void Framebuffer::delete_line( int row )
@@ -268,14 +348,7 @@ void Framebuffer::delete_line( int row )
     return;
   }
 
-  int insertbefore = ds.get_scrolling_region_bottom_row() + 1;
-  if ( insertbefore == ds.get_height() ) {
-    rows.push_back( newrow() );
-  } else {
-    rows.insert( rows.begin() + insertbefore, newrow() );
-  }
-
-  rows.erase( rows.begin() + row );
+  shift_rows( row, ds.get_scrolling_region_bottom_row(), 1 );
 }
 
 void Row::insert_cell( int col, int background_color )
@@ -292,19 +365,20 @@ void Row::delete_cell( int col, int background_color )
 
 void Framebuffer::insert_cell( int row, int col )
 {
-  rows[ row ].insert_cell( col, ds.get_background_rendition() );
+  get_mutable_row( row, col, ds.get_width() )->insert_cell( col, ds.get_background_rendition() );
 }
 
 void Framebuffer::delete_cell( int row, int col )
 {
-  rows[ row ].delete_cell( col, ds.get_background_rendition() );
+  get_mutable_row( row, col, ds.get_width() )->delete_cell( col, ds.get_background_rendition() );
 }
 
 void Framebuffer::reset( void )
 {
   int width = ds.get_width(), height = ds.get_height();
   ds = DrawState( width, height );
-  rows = std::deque<Row>( height, newrow() );
+  rows = rows_type( height, newrow() );
+  row_origin = 0;
   window_title.clear();
   /* do not reset bell_count */
 }
@@ -325,17 +399,48 @@ void Framebuffer::resize( int s_width, int s_height )
   assert( s_width > 0 );
   assert( s_height > 0 );
 
+  /* put the top row back at the start of the buffer */
+  std::rotate( rows.begin(), rows.begin() + row_origin, rows.end() );
+  row_origin = 0;
+
   rows.resize( s_height, newrow() );
 
-  for ( std::deque<Row>::iterator i = rows.begin();
-	i != rows.end();
-	i++ ) {
-    (*i).cells.resize( s_width, Cell( ds.get_background_rendition() ) );
+  for ( int i = 0; i < s_height; i++ ) {
+    if ( (int)rows[ i ]->cells.size() != s_width ) {
+      get_mutable_row( i )->cells.resize( s_width, Cell( ds.get_background_rendition() ) );
+    }
   }
 
   ds.resize( s_width, s_height );
 }
 
+void Framebuffer::reorder_rows( const std::vector<int> &source )
+{
+  const int height = ds.get_height();
+  assert( (int)source.size() == height );
+
+  rows_type old_rows;
+  old_rows.reserve( height );
+  for ( int i = 0; i < height; i++ ) {
+    old_rows.push_back( row_slot( i ) );
+  }
+
+  row_pointer blank;
+  for ( int i = 0; i < height; i++ ) {
+    if ( source[ i ] < 0 ) {
+      if ( !blank ) {
+	blank = row_pointer( new Row( ds.get_width(), 0 ) );
+      }
+      rows[ i ] = blank;
+    } else {
+      assert( source[ i ] < height );
+      rows[ i ] = old_rows[ source[ i ] ];
+    }
+  }
+
+  row_origin = 0;
+}
+
 void DrawState::resize( int s_width, int s_height )
 {
   if ( (width != s_width)
@@ -364,61 +469,119 @@ void DrawState::resize( int s_width, int s_height )
 }
 
 Renditions::Renditions( int s_background )
-  : bold( false ), underlined( false ), blink( false ),
-    inverse( false ), invisible( false ), foreground_color( 0 ),
-    background_color( s_background )
+  : foreground_color( 0 ), background_color( s_background ), attributes( 0 )
 {}
 
 void Renditions::set_rendition( int num )
 {
   if ( num == 0 ) {
-    bold = underlined = blink = inverse = invisible = false;
+    attributes = 0;
     foreground_color = background_color = 0;
     return;
   }
 
+  /* 39 and 49 select the default colors, stored the same as no color */
   if ( (30 <= num) && (num <= 39) ) { /* foreground color */
-    foreground_color = num;
+    foreground_color = (num == 39) ? 0 : num;
     return;
   } else if ( (40 <= num) && (num <= 49) ) { /* background color */
-    background_color = num;
+    background_color = (num == 49) ? 0 : num;
     return;
   }
 
   switch ( num ) {
-  case 1: case 22: bold = (num == 1); break;
-  case 4: case 24: underlined = (num == 4); break;
-  case 5: case 25: blink = (num == 5); break;
-  case 7: case 27: inverse = (num == 7); break;
-  case 8: case 28: invisible = (num == 8); break;
+  case 1: case 22: set_attribute( bold, num == 1 ); break;
+  case 4: case 24: set_attribute( underlined, num == 4 ); break;
+  case 5: case 25: set_attribute( blink, num == 5 ); break;
+  case 7: case 27: set_attribute( inverse, num == 7 ); break;
+  case 8: case 28: set_attribute( invisible, num == 8 ); break;
   }
 }
 
-std::string Renditions::sgr( void ) const
+/* SGR parameters that turn each attribute on and off */
+static const int attribute_on[ Renditions::SIZE ] = { 1, 4, 5, 7, 8 };
+static const int attribute_off[ Renditions::SIZE ] = { 22, 24, 25, 27, 28 };
+
+/* parameters are at most two digits */
+static void append_sgr_param( char *buf, int &len, int num )
 {
-  std::string ret;
+  if ( len ) {
+    buf[ len++ ] = ';';
+  }
+  if ( num >= 10 ) {
+    buf[ len++ ] = '0' + num / 10;
+  }
+  buf[ len++ ] = '0' + num % 10;
+}
+
+/* the parameters for a reset followed by everything that is set */
+int Renditions::sgr_params( char *buf ) const
+{
+  int len = 0;
 
-  ret.append( "\033[0" );
-  if ( bold ) ret.append( ";1" );
-  if ( underlined ) ret.append( ";4" );
-  if ( blink ) ret.append( ";5" );
-  if ( inverse ) ret.append( ";7" );
-  if ( invisible ) ret.append( ";8" );
+  append_sgr_param( buf, len, 0 );
+  for ( int i = 0; i < SIZE; i++ ) {
+    if ( get_attribute( attribute_type( i ) ) ) {
+      append_sgr_param( buf, len, attribute_on[ i ] );
+    }
+  }
   if ( foreground_color ) {
-    char col[ 8 ];
-    snprintf( col, 8, ";%d", foreground_color );
-    ret.append( col );
+    append_sgr_param( buf, len, foreground_color );
   }
   if ( background_color ) {
-    char col[ 8 ];
-    snprintf( col, 8, ";%d", background_color );
-    ret.append( col );
+    append_sgr_param( buf, len, background_color );
   }
+
+  return len;
+}
+
+std::string Renditions::sgr( void ) const
+{
+  char params[ SGR_MAX ];
+  int len = sgr_params( params );
+
+  std::string ret( "\033[" );
+  ret.append( params, len );
   ret.append( "m" );
 
   return ret;
 }
 
+void Renditions::sgr_change( const Renditions &current, std::string &output ) const
+{
+  if ( *this == current ) {
+    return;
+  }
+
+  /* just the differences, unless a reset is shorter */
+  char change[ SGR_MAX ];
+  int change_len = 0;
+
+  for ( int i = 0; i < SIZE; i++ ) {
+    bool val = get_attribute( attribute_type( i ) );
+    if ( val != current.get_attribute( attribute_type( i ) ) ) {
+      append_sgr_param( change, change_len, val ? attribute_on[ i ] : attribute_off[ i ] );
+    }
+  }
+  if ( foreground_color != current.foreground_color ) {
+    append_sgr_param( change, change_len, foreground_color ? foreground_color : 39 );
+  }
+  if ( background_color != current.background_color ) {
+    append_sgr_param( change, change_len, background_color ? background_color : 49 );
+  }
+
+  char full[ SGR_MAX ];
+  int full_len = sgr_params( full );
+
+  output.append( "\033[" );
+  if ( full_len < change_len ) {
+    output.append( full, full_len );
+  } else {
+    output.append( change, change_len );
+  }
+  output.append( "m" );
+}
+
 void Row::reset( int background_color )
 {
   for ( std::vector<Cell>::iterator i = cells.begin();
@@ -428,6 +591,20 @@ void Row::reset( int background_color )
   }
 }
 
+void Row::recycle( int background_color )
+{
+  reset( background_color );
+  wrap = false;
+
+  /* the new row has no history */
+  for ( int i = 0; i < DIRTY_HISTORY; i++ ) {
+    ancestor_gen[ i ] = 0;
+    dirty_start[ i ] = dirty_end[ i ] = 0;
+  }
+
+  invalidate();
+}
+
 void Framebuffer::prefix_window_title( const std::deque<wchar_t> &s )
 {
   for ( BOOST_AUTO( i, s.rbegin() ); i != s.rend(); i++ ) {
@@ -435,11 +612,138 @@ void Framebuffer::prefix_window_title( const std::deque<wchar_t> &s )
   }
 }
 
+uint64_t Row::get_gen( void )
+{
+  static uint64_t gen_counter = 0;
+  return ++gen_counter;
+}
+
+void Row::derive( void )
+{
+  for ( int i = DIRTY_HISTORY - 1; i > 0; i-- ) {
+    ancestor_gen[ i ] = ancestor_gen[ i - 1 ];
+    dirty_start[ i ] = dirty_start[ i - 1 ];
+    dirty_end[ i ] = dirty_end[ i - 1 ];
+  }
+
+  ancestor_gen[ 0 ] = gen;
+  dirty_start[ 0 ] = dirty_end[ 0 ] = 0;
+}
+
+void Row::mark_dirty( int start, int end )
+{
+  for ( int i = 0; i < DIRTY_HISTORY; i++ ) {
+    if ( dirty_start[ i ] == dirty_end[ i ] ) {
+      dirty_start[ i ] = start;
+      dirty_end[ i ] = end;
+    } else {
+      if ( start < dirty_start[ i ] ) dirty_start[ i ] = start;
+      if ( end > dirty_end[ i ] ) dirty_end[ i ] = end;
+    }
+  }
+}
+
+bool Row::dirty_since( uint64_t ancestor, int &start, int &end ) const
+{
+  if ( ancestor == gen ) {
+    start = end = 0;
+    return true;
+  }
+
+  for ( int i = 0; i < DIRTY_HISTORY; i++ ) {
+    if ( ancestor_gen[ i ] == ancestor ) {
+      start = dirty_start[ i ];
+      end = dirty_end[ i ];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint64_t Row::hash( void ) const
+{
+  if ( !hash_valid ) {
+    uint64_t h = 14695981039346656037ULL;
+    for ( std::vector<Cell>::const_iterator i = cells.begin();
+	  i != cells.end();
+	  i++ ) {
+      h = i->hash( h );
+    }
+    h = (h ^ wrap) * 1099511628211ULL;
+
+    hash_value = h;
+    hash_valid = true;
+  }
+
+  return hash_value;
+}
+
+uint64_t Cell::hash( uint64_t h ) const
+{
+  static const uint64_t prime = 1099511628211ULL;
+
+  for ( std::string::const_iterator i = contents.begin();
+	i != contents.end();
+	i++ ) {
+    h = (h ^ (unsigned char)*i) * prime;
+  }
+
+  /* terminate the contents so that adjacent cells can't alias */
+  h = (h ^ 0xFF) * prime;
+  h = (h ^ renditions.get_foreground_color()) * prime;
+  h = (h ^ renditions.get_background_color()) * prime;
+  h = (h ^ (renditions.get_attributes())) * prime;
+  h = (h ^ ((wide << 1) | fallback)) * prime;
+
+  return h;
+}
+
+bool Framebuffer::operator==( const Framebuffer &x ) const
+{
+  if ( !( ( window_title == x.window_title ) && ( bell_count == x.bell_count ) && ( ds == x.ds ) ) ) {
+    return false;
+  }
+
+  for ( size_t i = 0; i < rows.size(); i++ ) {
+    if ( row_slot( i ) == x.row_slot( i ) ) {
+      continue; /* shared row */
+    }
+
+    const Row &a = *row_slot( i ), &b = *x.row_slot( i );
+
+    if ( a.gen != b.gen ) {
+      /* remember the hashes so that repeated comparisons
+	 of two different rows stay cheap */
+      if ( a.hash() != b.hash() ) {
+	return false;
+      }
+
+      if ( !( a == b ) ) {
+	return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 wchar_t Cell::debug_contents( void ) const
 {
   if ( contents.empty() ) {
     return '_';
+  }
+
+  /* decode the first character */
+  const unsigned char *s = (const unsigned char *)contents.data();
+  if ( s[ 0 ] < 0x80 ) {
+    return s[ 0 ];
+  } else if ( s[ 0 ] < 0xE0 ) {
+    return ((s[ 0 ] & 0x1F) << 6) | (s[ 1 ] & 0x3F);
+  } else if ( s[ 0 ] < 0xF0 ) {
+    return ((s[ 0 ] & 0x0F) << 12) | ((s[ 1 ] & 0x3F) << 6) | (s[ 2 ] & 0x3F);
   } else {
-    return contents.front();
+    return ((s[ 0 ] & 0x07) << 18) | ((s[ 1 ] & 0x3F) << 12)
+      | ((s[ 2 ] & 0x3F) << 6) | (s[ 3 ] & 0x3F);
   }
 }
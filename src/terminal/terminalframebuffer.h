@@ -24,48 +24,80 @@
 #include <string>
 #include <list>
 #include <assert.h>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
 
 /* Terminal framebuffer */
 
 namespace Terminal {
   class Renditions {
   public:
-    bool bold, underlined, blink, inverse, invisible;
-    int foreground_color;
-    int background_color;
+    typedef enum { bold, underlined, blink, inverse, invisible, SIZE } attribute_type;
 
+  private:
+    /* packed so that copying and comparing renditions is cheap */
+    unsigned char foreground_color;
+    unsigned char background_color;
+    unsigned char attributes;
+
+    static const int SGR_MAX = 32; /* longest parameter list */
+    int sgr_params( char *buf ) const;
+
+  public:
     Renditions( int s_background );
     void set_rendition( int num );
     std::string sgr( void ) const;
 
+    /* append the SGR sequence that changes a terminal's
+       renditions from "current" to these */
+    void sgr_change( const Renditions &current, std::string &output ) const;
+
+    int get_foreground_color( void ) const { return foreground_color; }
+    int get_background_color( void ) const { return background_color; }
+    void set_foreground_color( int num ) { foreground_color = num; }
+    void set_background_color( int num ) { background_color = num; }
+
+    bool get_attribute( attribute_type attr ) const { return attributes & (1 << attr); }
+    int get_attributes( void ) const { return attributes; }
+    void set_attribute( attribute_type attr, bool val )
+    {
+      if ( val ) {
+	attributes |= (1 << attr);
+      } else {
+	attributes &= ~(1 << attr);
+      }
+    }
+
     bool operator==( const Renditions &x ) const
     {
-      return (bold == x.bold) && (underlined == x.underlined)
-	&& (blink == x.blink) && (inverse == x.inverse)
-	&& (invisible == x.invisible) && (foreground_color == x.foreground_color)
+      return (attributes == x.attributes) && (foreground_color == x.foreground_color)
 	&& (background_color == x.background_color);
     }
   };
 
   class Cell {
+  private:
+    /* UTF-8. A single character or a short combining sequence fits in
+       the string's inline buffer, so most cells never touch the heap. */
+    std::string contents;
+
   public:
-    std::vector<wchar_t> contents;
-    char fallback; /* first character is combining character */
-    int width;
     Renditions renditions;
+    bool wide; /* occupies two columns */
+    bool fallback; /* first character is combining character */
 
     Cell( int background_color )
       : contents(),
-	fallback( false ),
-	width( 1 ),
-	renditions( background_color )
+	renditions( background_color ),
+	wide( false ),
+	fallback( false )
     {}
 
     Cell() /* default constructor required by C++11 STL */
       : contents(),
-	fallback( false ),
-	width( 1 ),
-	renditions( 0 )
+	renditions( 0 ),
+	wide( false ),
+	fallback( false )
     {
       assert( false );
     }
@@ -74,10 +106,35 @@ namespace Terminal {
 
     bool operator==( const Cell &x ) const
     {
-      return ( (contents == x.contents)
+      return ( (renditions == x.renditions)
+	       && (wide == x.wide)
 	       && (fallback == x.fallback)
-	       && (width == x.width)
-	       && (renditions == x.renditions) );
+	       && (contents == x.contents) );
+    }
+
+    bool contents_match( const Cell &x ) const { return contents == x.contents; }
+
+    const std::string & get_contents( void ) const { return contents; }
+    void set_contents( const std::string &s, size_t pos, size_t len ) { contents.assign( s, pos, len ); }
+
+    /* mix this cell into a running FNV-1a hash */
+    uint64_t hash( uint64_t h ) const;
+
+    bool empty( void ) const { return contents.empty(); }
+    void clear( void ) { contents.clear(); }
+    void append( wchar_t c );
+    size_t char_count( void ) const;
+
+    int get_width( void ) const { return wide ? 2 : 1; }
+
+    /* append the cell's UTF-8 to a frame, attaching a leading combining
+       character to a no-break space */
+    void print_grapheme( std::string &output ) const
+    {
+      if ( fallback ) {
+	output.append( "\xC2\xA0" );
+      }
+      output.append( contents );
     }
 
     wchar_t debug_contents( void ) const;
@@ -85,22 +142,44 @@ namespace Terminal {
     bool is_blank( void ) const
     {
       return ( contents.empty()
-	       || ( (contents.size() == 1) && ( (contents.front() == 0x20)
-						|| (contents.front() == 0xA0) ) ) );
+	       || ( contents == " " )
+	       || ( contents == "\xC2\xA0" ) );
     }
   };
 
   class Row {
+  private:
+    mutable uint64_t hash_value;
+    mutable bool hash_valid;
+
+    /* Columns changed since each of the row's most recent ancestors
+       (earlier versions that other snapshots may still hold), so a
+       frame can be drawn against an old snapshot by visiting only
+       the dirty span. An ancestor generation of zero is unused. */
+    static const int DIRTY_HISTORY = 4;
+    uint64_t ancestor_gen[ DIRTY_HISTORY ];
+    int dirty_start[ DIRTY_HISTORY ];
+    int dirty_end[ DIRTY_HISTORY ];
+
   public:
     std::vector<Cell> cells;
     bool wrap;
 
+    /* Rows with the same generation are unmodified copies of one
+       another. The generation changes whenever the row is handed out
+       for modification. */
+    uint64_t gen;
+
     Row( size_t s_width, int background_color )
-      : cells( s_width, Cell( background_color ) ), wrap( false )
+      : hash_value( 0 ), hash_valid( false ),
+	ancestor_gen(), dirty_start(), dirty_end(),
+	cells( s_width, Cell( background_color ) ), wrap( false ), gen( get_gen() )
     {}
 
     Row() /* default constructor required by C++11 STL */
-      : cells( 1, Cell() ), wrap( false )
+      : hash_value( 0 ), hash_valid( false ),
+	ancestor_gen(), dirty_start(), dirty_end(),
+	cells( 1, Cell() ), wrap( false ), gen( get_gen() )
     {
       assert( false );
     }
@@ -110,10 +189,36 @@ namespace Terminal {
 
     void reset( int background_color );
 
+    /* turn this row into a new blank row, reusing its storage */
+    void recycle( int background_color );
+
+    /* called before the row is modified */
+    void invalidate( void ) { gen = get_gen(); hash_valid = false; }
+
+    /* called on a copy that is about to diverge from its original */
+    void derive( void );
+    void mark_dirty( int start, int end );
+
+    /* which columns may differ from the version of this row with
+       generation "ancestor"? false if that version isn't known */
+    bool dirty_since( uint64_t ancestor, int &start, int &end ) const;
+
+    uint64_t hash( void ) const;
+
     bool operator==( const Row &x ) const
     {
-      return ( (cells == x.cells) && (wrap == x.wrap) );
+      if ( gen == x.gen ) {
+	return true;
+      }
+
+      if ( hash_valid && x.hash_valid && (hash_value != x.hash_value) ) {
+	return false;
+      }
+
+      return ( (wrap == x.wrap) && (cells == x.cells) );
     }
+
+    static uint64_t get_gen( void );
   };
 
   class SavedCursor {
@@ -184,7 +289,8 @@ namespace Terminal {
 
     void add_rendition( int x ) { renditions.set_rendition( x ); }
     Renditions get_renditions( void ) const { return renditions; }
-    int get_background_rendition( void ) { return renditions.background_color; }
+    void set_renditions( const Renditions &r ) { renditions = r; }
+    int get_background_rendition( void ) const { return renditions.get_background_color(); }
 
     void save_cursor( void );
     void restore_cursor( void );
@@ -205,11 +311,36 @@ namespace Terminal {
 
   class Framebuffer {
   private:
-    std::deque<Row> rows;
+    /* Rows are shared between copies of a Framebuffer and copied
+       only when they are about to be modified (see get_mutable_row). */
+    typedef boost::shared_ptr<Row> row_pointer;
+    typedef std::vector<row_pointer> rows_type;
+
+    /* The rows form a circular buffer starting at row_origin,
+       so scrolling the whole screen only moves the origin. */
+    rows_type rows;
+    int row_origin;
     std::deque<wchar_t> window_title;
     unsigned int bell_count;
 
-    Row newrow( void ) { return Row( ds.get_width(), ds.get_background_rendition() ); }
+    row_pointer newrow( void ) { return row_pointer( new Row( ds.get_width(), ds.get_background_rendition() ) ); }
+
+    row_pointer & row_slot( int row )
+    {
+      int slot = row_origin + row;
+      if ( slot >= (int)rows.size() ) slot -= rows.size();
+      return rows[ slot ];
+    }
+
+    const row_pointer & row_slot( int row ) const
+    {
+      int slot = row_origin + row;
+      if ( slot >= (int)rows.size() ) slot -= rows.size();
+      return rows[ slot ];
+    }
+
+    void blank_row( row_pointer &r );
+    void shift_rows( int top, int bottom, int N );
 
   public:
     Framebuffer( int s_width, int s_height );
@@ -222,12 +353,12 @@ namespace Terminal {
     {
       if ( row == -1 ) row = ds.get_cursor_row();
 
-      return &rows[ row ];
+      return row_slot( row ).get();
     }
 
     inline const Cell *get_cell( void ) const
     {
-      return &rows[ ds.get_cursor_row() ].cells[ ds.get_cursor_col() ];
+      return &row_slot( ds.get_cursor_row() )->cells[ ds.get_cursor_col() ];
     }
 
     inline const Cell *get_cell( int row, int col ) const
@@ -235,27 +366,42 @@ namespace Terminal {
       if ( row == -1 ) row = ds.get_cursor_row();
       if ( col == -1 ) col = ds.get_cursor_col();
 
-      return &rows[ row ].cells[ col ];
+      return &row_slot( row )->cells[ col ];
     }
 
-    Row *get_mutable_row( int row )
+    /* hand out a row for modification of columns [start, end) */
+    Row *get_mutable_row( int row, int start, int end )
     {
       if ( row == -1 ) row = ds.get_cursor_row();
 
-      return &rows[ row ];
+      row_pointer &mutable_row = row_slot( row );
+      if ( !mutable_row.unique() ) {
+	/* copy on write */
+	mutable_row = row_pointer( new Row( *mutable_row ) );
+	mutable_row->derive();
+      }
+
+      mutable_row->invalidate();
+      mutable_row->mark_dirty( start, end );
+      return mutable_row.get();
+    }
+
+    Row *get_mutable_row( int row )
+    {
+      return get_mutable_row( row, 0, ds.get_width() );
     }
 
     inline Cell *get_mutable_cell( void )
     {
-      return &rows[ ds.get_cursor_row() ].cells[ ds.get_cursor_col() ];
+      int col = ds.get_cursor_col();
+      return &get_mutable_row( -1, col, col + 1 )->cells[ col ];
     }
 
     inline Cell *get_mutable_cell( int row, int col )
     {
-      if ( row == -1 ) row = ds.get_cursor_row();
       if ( col == -1 ) col = ds.get_cursor_col();
 
-      return &rows[ row ].cells[ col ];
+      return &get_mutable_row( row, col, col + 1 )->cells[ col ];
     }
 
     Cell *get_combining_cell( void );
@@ -278,16 +424,18 @@ namespace Terminal {
 
     void resize( int s_width, int s_height );
 
+    /* row i becomes the old row source[ i ], or a blank row in the
+       default renditions where that is -1 */
+    void reorder_rows( const std::vector<int> &source );
+
     void reset_cell( Cell *c ) { c->reset( ds.get_background_rendition() ); }
     void reset_row( Row *r ) { r->reset( ds.get_background_rendition() ); }
 
     void ring_bell( void ) { bell_count++; }
     unsigned int get_bell_count( void ) const { return bell_count; }
+    void set_bell_count( unsigned int n ) { bell_count = n; }
 
-    bool operator==( const Framebuffer &x ) const
-    {
-      return ( rows == x.rows ) && ( window_title == x.window_title ) && ( bell_count == x.bell_count ) && ( ds == x.ds );
-    }
+    bool operator==( const Framebuffer &x ) const;
   };
 }
 
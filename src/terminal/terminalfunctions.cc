@@ -83,7 +83,7 @@ void CSI_cursormove( Framebuffer *fb, Dispatcher *dispatch )
 {
   int num = dispatch->getparam( 0, 1 );
 
-  switch ( dispatch->get_dispatch_chars()[ 0 ] ) {
+  switch ( dispatch->get_final_char() ) {
   case 'A':
     fb->ds.move_row( -num, true );
     break;
@@ -134,7 +134,7 @@ void Esc_DECALN( Framebuffer *fb, Dispatcher *dispatch __attribute((unused)) )
   for ( int y = 0; y < fb->ds.get_height(); y++ ) {
     for ( int x = 0; x < fb->ds.get_width(); x++ ) {
       fb->reset_cell( fb->get_mutable_cell( y, x ) );
-      fb->get_mutable_cell( y, x )->contents.push_back( L'E' );
+      fb->get_mutable_cell( y, x )->append( L'E' );
     }
   }
 }
@@ -481,7 +481,7 @@ void CSI_DECSTR( Framebuffer *fb, Dispatcher *dispatch __attribute((unused)) )
 static Function func_CSI_DECSTR( CSI, "!p", CSI_DECSTR );
 
 /* xterm uses an Operating System Command to set the window title */
-void Dispatcher::OSC_dispatch( const Parser::OSC_End *act, Framebuffer *fb )
+void Dispatcher::OSC_dispatch( const Parser::HostAction *act, Framebuffer *fb )
 {
   if ( OSC_string.size() >= 2 ) {
     if ( (OSC_string[ 0 ] == L'0')
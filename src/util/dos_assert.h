@@ -24,7 +24,7 @@
 
 #include "crypto.h"
 
-static void dos_detected( const char *expression, const char *file, int line, const char *function )
+static inline void dos_detected( const char *expression, const char *file, int line, const char *function )
 {
   char buffer[ 2048 ];
   snprintf( buffer, 2048, "Illegal counterparty input (possible denial of service) in function %s at %s:%d, failed test: %s\n",
@@ -0,0 +1,42 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MODIFICATION_STAMP_HPP
+#define MODIFICATION_STAMP_HPP
+
+#include <stdint.h>
+
+/* A stamp for a state object, taken from a counter on every change.
+   Copying the object copies the stamp, so two objects with the same
+   stamp are equal (one is an unmodified copy of the other) and need no
+   deeper comparison. Different stamps say nothing either way. */
+class ModificationStamp
+{
+private:
+  uint64_t stamp;
+
+  static uint64_t next( void );
+
+public:
+  ModificationStamp() : stamp( next() ) {}
+
+  void touch( void ) { stamp = next(); }
+  uint64_t get( void ) const { return stamp; }
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MOSH_WCWIDTH_HPP
+#define MOSH_WCWIDTH_HPP
+
+#include <wchar.h>
+
+/* The width of a character in terminal cells, as wcwidth() gives it,
+   but independent of the locale and C library. The client and server
+   use the same table, so predictions agree with what the server draws.
+   The table in mosh_wcwidth.cc is generated by mosh_wcwidth_gen.cc. */
+
+extern const unsigned char mosh_wcwidth_index[];
+extern const unsigned char mosh_wcwidth_blocks[][ 64 ];
+
+inline int mosh_wcwidth( wchar_t c )
+{
+  if ( (0x20 <= c) && (c < 0x7F) ) {
+    return 1;
+  }
+
+  if ( (c < 0) || (c > 0x10FFFF) ) {
+    return -1;
+  }
+
+  unsigned int bits = mosh_wcwidth_blocks[ mosh_wcwidth_index[ c >> 8 ] ][ (c & 0xFF) >> 2 ];
+  return ((bits >> ((c & 3) * 2)) & 3) - 1;
+}
+
+#endif
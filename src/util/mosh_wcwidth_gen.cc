@@ -0,0 +1,99 @@
+/*
+    Mosh: the mobile shell
+    Copyright 2012 Keith Winstein
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Generates mosh_wcwidth.cc, the table behind mosh_wcwidth(), from the
+   C library's wcwidth() in a UTF-8 locale:
+
+   ./mosh_wcwidth_gen > mosh_wcwidth.cc
+
+   Widths are stored two bits per character (width plus one) in blocks
+   of 256 characters. Identical blocks are shared, so an index of one
+   byte per block is enough. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <wchar.h>
+#include <vector>
+#include <string>
+
+static const unsigned int BLOCK_SIZE = 256;
+static const unsigned int MAX_CHAR = 0x10FFFF;
+
+int main( void )
+{
+  if ( (setlocale( LC_CTYPE, "C.UTF-8" ) == NULL)
+       && (setlocale( LC_CTYPE, "en_US.UTF-8" ) == NULL) ) {
+    fprintf( stderr, "mosh_wcwidth_gen: no UTF-8 locale available.\n" );
+    return 1;
+  }
+
+  std::vector<std::string> blocks;
+  std::vector<unsigned int> index;
+
+  for ( unsigned int base = 0; base <= MAX_CHAR; base += BLOCK_SIZE ) {
+    std::string block( BLOCK_SIZE / 4, '\0' );
+    for ( unsigned int i = 0; i < BLOCK_SIZE; i++ ) {
+      int width = wcwidth( base + i );
+      if ( (width < -1) || (width > 2) ) {
+	fprintf( stderr, "mosh_wcwidth_gen: unexpected width %d for U+%04X.\n", width, base + i );
+	return 1;
+      }
+      block[ i / 4 ] |= (width + 1) << ((i % 4) * 2);
+    }
+
+    unsigned int n;
+    for ( n = 0; n < blocks.size(); n++ ) {
+      if ( blocks[ n ] == block ) {
+	break;
+      }
+    }
+    if ( n == blocks.size() ) {
+      blocks.push_back( block );
+    }
+    index.push_back( n );
+  }
+
+  if ( blocks.size() > 256 ) {
+    fprintf( stderr, "mosh_wcwidth_gen: too many distinct blocks (%d).\n", (int)blocks.size() );
+    return 1;
+  }
+
+  printf( "/* Generated by mosh_wcwidth_gen from the C library's wcwidth(); do not edit. */\n\n" );
+  printf( "#include \"mosh_wcwidth.h\"\n\n" );
+
+  printf( "const unsigned char mosh_wcwidth_index[ %d ] = {", (int)index.size() );
+  for ( unsigned int i = 0; i < index.size(); i++ ) {
+    printf( "%s%d,", (i % 16) ? " " : "\n  ", index[ i ] );
+  }
+  printf( "\n};\n\n" );
+
+  printf( "const unsigned char mosh_wcwidth_blocks[ %d ][ %d ] = {\n", (int)blocks.size(), BLOCK_SIZE / 4 );
+  for ( unsigned int n = 0; n < blocks.size(); n++ ) {
+    printf( "  {" );
+    for ( unsigned int i = 0; i < BLOCK_SIZE / 4; i++ ) {
+      printf( "%s0x%02x,", (i % 16) ? " " : "\n    ", (unsigned char)blocks[ n ][ i ] );
+    }
+    printf( "\n  },\n" );
+  }
+  printf( "};\n" );
+
+  return 0;
+}